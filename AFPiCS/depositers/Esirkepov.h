@@ -6,18 +6,33 @@
   
   \brief Esirkepov charge deposition algorithm.
   
+  \remark The way the contributions of the particles are accumulated
+          can be chosen through the reduction policy
+          (see `Reductions::Atomic` and `Reductions::PrivateBuffers`).
+  
   \author Nuno Fernandes
 */
 
 #include "../header.h"
 #include "../utilities/particle_storage.h"
+#include "../utilities/reductions.h"
+#include "../utilities/stream_compaction.h"
+#include "../utilities/planar_fields.h"
+#include "../utilities/ghost_cells.h"
+#include "../utilities/tracing.h"
+#include "../system_info/system_info_maker.h"
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <numeric>
+#include <type_traits>
 
 namespace AFFPiCS
 {
   namespace Depositers
   {
-    template <class system_info, indexer num_dims, template <indexer> class ... particles>
-    class Esirkepov
+    template <class reduction, class system_info, indexer num_dims, template <indexer> class ... particles>
+    class EsirkepovWithReduction
     {
       
       template <class parallelism>
@@ -32,6 +47,7 @@ namespace AFFPiCS
                                         const vector_type<indexer, num_dims> &this_cell,
                                         const vector_type<bool, num_dims> &mirrored,
                                         const particle& part,
+                                        const vector_type<FLType, num_dims> &vel,
                                         TempArr& temp_W,
                                         const FLType dt,
                                         const S_Info &I) const
@@ -41,8 +57,8 @@ namespace AFFPiCS
             //and -1 where it is true.
             
             const vector_type<FLType, num_dims>
-                      flux_factor = part.charge(I) * part.vel(I).element_multiply(I.cell_sizes()).element_multiply(mirror_sign);
-            //A factor of q v that appears
+                      flux_factor = part.charge(I) * part.weight(I) * vel.element_multiply(I.cell_sizes()).element_multiply(mirror_sign);
+            //A factor of q w v that appears (w being the weight of the particle, see `particle_base::weight`)
             //(Note the sign from the velocity part because of mirrored.)
             
             const vector_type<FLType, num_dims> p_i = part.pos(I).element_multiply(mirror_sign) +
@@ -55,7 +71,7 @@ namespace AFFPiCS
             //We element_multiply by mirror_sign to get -pos[dim] in the right places
             //and add mirrored since it's 1 in the mirrored dimensions and 0 otherwise.
             
-            const vector_type<FLType, num_dims> dp = part.vel(I).element_multiply(mirror_sign) * dt;
+            const vector_type<FLType, num_dims> dp = vel.element_multiply(mirror_sign) * dt;
             //The variation in position.
             //(Note the sign from the velocity part because of mirrored.)
             
@@ -66,7 +82,7 @@ namespace AFFPiCS
               {
                 const FLType W_x = (I.*S)(part, p_i + dp) - (I.*S)(part, p_i);
                 //S(x+dx) - S(x)
-                parallelism::atomics::add(temp_W[idx][0], flux_factor[0] * W_x);
+                reduction::template add<parallelism>(temp_W[idx][0], flux_factor[0] * W_x);
               }
             else if constexpr (num_dims == 2)
               {
@@ -76,8 +92,8 @@ namespace AFFPiCS
                 //W_x = S(x+dx, y+dy)/2 + S(x+dx, y)/2 - S(x, y+dy)/2 - S(x, y)/2
                 const FLType W_y = W_general + ((I.*S)(part, p_i + dp.set(0, 0)) - (I.*S)(part, p_i + dp.set(1, 0)))/2;
                 //W_y = S(x+dx, y+dy) + S(x, y+dy) - S(x+dx, y) - S(x, y)
-                parallelism::atomics::add(temp_W[idx][0], flux_factor[0] * W_x);
-                parallelism::atomics::add(temp_W[idx][1], flux_factor[1] * W_y);
+                reduction::template add<parallelism>(temp_W[idx][0], flux_factor[0] * W_x);
+                reduction::template add<parallelism>(temp_W[idx][1], flux_factor[1] * W_y);
               }
             else if constexpr (num_dims == 3)
               {
@@ -96,9 +112,9 @@ namespace AFFPiCS
                 
                 const FLType W_z = W_general + ((I.*S)(part, p_i + dp.set(0, 0).set(1, 0)) - (I.*S)(part, p_i + dp.set(2, 0)))/2;
                 
-                parallelism::atomics::add(temp_W[idx][0], flux_factor[0] * W_x);
-                parallelism::atomics::add(temp_W[idx][1], flux_factor[1] * W_y);
-                parallelism::atomics::add(temp_W[idx][2], flux_factor[2] * W_z);
+                reduction::template add<parallelism>(temp_W[idx][0], flux_factor[0] * W_x);
+                reduction::template add<parallelism>(temp_W[idx][1], flux_factor[1] * W_y);
+                reduction::template add<parallelism>(temp_W[idx][2], flux_factor[2] * W_z);
               }
             else
               {
@@ -119,9 +135,102 @@ namespace AFFPiCS
                                            const FLType dt,
                                            const S_Info &info       ) const
         {
-          info.template for_all_neighbours<true>( info.template particle_cell_radius<particle>(part) + 1,
-                                                   part.cell(info), neighbour_functor{},
-                                                   part, temp_W, dt, info );
+          info.template for_all_neighbours<false>( info.template particle_cell_radius<particle>(part) + 1,
+                                                    part.cell(info), neighbour_functor{},
+                                                    part, part.vel(info), temp_W, dt, info );
+          //Interior particles never reach the boundaries of the system,
+          //so there's no need to check for them.
+        }
+        
+        template <class particle, class TempArr, class S_Info>
+        CUDA_HOS_DEV void deposit_interior_separable(const particle& part,
+                                                     TempArr & temp_W,
+                                                     const FLType dt,
+                                                     const S_Info &info,
+                                                     const indexer radius) const
+        //When the shape is a product of 1D shapes,
+        //S(x, y, z) = S_x(x) S_y(y) S_z(z) and the expressions for W in neighbour_functor
+        //reduce to products of the 1D shapes at the initial (S0) and final (S1) positions.
+        //For instance, in 3D:
+        //W_x = (S1_x - S0_x) (2 S1_y S1_z + S0_y S1_z + S1_y S0_z + 2 S0_y S0_z) / 6
+        //    = DS_x (S0_y S0_z + (DS_y S0_z + S0_y DS_z)/2 + DS_y DS_z / 3), with DS = S1 - S0.
+        //Thus we only need to evaluate the 1D shapes 2 (2 radius + 1) times per dimension
+        //and no longer need to go through for_all_neighbours.
+        {
+          constexpr indexer max_size = 2 * (Defaults::separable_max_radius + 1) + 1;
+          
+          const indexer size = 2 * radius + 1;
+          
+          const vector_type<indexer, num_dims> cell = part.cell(info);
+          const vector_type<FLType, num_dims> pos = part.pos(info);
+          const vector_type<FLType, num_dims> vel = part.vel(info);
+          
+          const vector_type<FLType, num_dims> flux_factor = part.charge(info) * part.weight(info) * vel.element_multiply(info.cell_sizes());
+          
+          FLType S0[num_dims][max_size], DS[num_dims][max_size];
+          
+          indexer strides[num_dims];
+          
+          const indexer center = info.to_index(cell);
+          
+          for (indexer d = 0; d < num_dims; ++d)
+            {
+              for (indexer k = 0; k < size; ++k)
+                {
+                  const FLType x = pos[d] - (k - radius);
+                  //The initial position in relation to the cell with an offset of k - radius.
+                  S0[d][k] = info.template particle_fraction_1D<particle>(part, x);
+                  DS[d][k] = info.template particle_fraction_1D<particle>(part, x + vel[d] * dt) - S0[d][k];
+                }
+              strides[d] = info.to_index(cell.add(d, 1)) - center;
+              //Since we are in the interior, the linear index is affine in the cell.
+            }
+          
+          const indexer start = center - radius * std::accumulate(strides, strides + num_dims, indexer(0));
+          
+          if constexpr (num_dims == 1)
+            {
+              for (indexer i = 0; i < size; ++i)
+                {
+                  reduction::template add<parallelism>(temp_W[start + i * strides[0]][0], flux_factor[0] * DS[0][i]);
+                }
+            }
+          else if constexpr (num_dims == 2)
+            {
+              for (indexer i = 0; i < size; ++i)
+                {
+                  for (indexer j = 0; j < size; ++j)
+                    {
+                      const indexer idx = start + i * strides[0] + j * strides[1];
+                      const FLType W_x = DS[0][i] * (S0[1][j] + DS[1][j]/2);
+                      const FLType W_y = DS[1][j] * (S0[0][i] + DS[0][i]/2);
+                      reduction::template add<parallelism>(temp_W[idx][0], flux_factor[0] * W_x);
+                      reduction::template add<parallelism>(temp_W[idx][1], flux_factor[1] * W_y);
+                    }
+                }
+            }
+          else if constexpr (num_dims == 3)
+            {
+              for (indexer i = 0; i < size; ++i)
+                {
+                  for (indexer j = 0; j < size; ++j)
+                    {
+                      for (indexer k = 0; k < size; ++k)
+                        {
+                          const indexer idx = start + i * strides[0] + j * strides[1] + k * strides[2];
+                          const FLType W_x = DS[0][i] * ( S0[1][j] * S0[2][k] + (DS[1][j] * S0[2][k] + S0[1][j] * DS[2][k])/2 +
+                                                          DS[1][j] * DS[2][k] / 3 );
+                          const FLType W_y = DS[1][j] * ( S0[0][i] * S0[2][k] + (DS[0][i] * S0[2][k] + S0[0][i] * DS[2][k])/2 +
+                                                          DS[0][i] * DS[2][k] / 3 );
+                          const FLType W_z = DS[2][k] * ( S0[0][i] * S0[1][j] + (DS[0][i] * S0[1][j] + S0[0][i] * DS[1][j])/2 +
+                                                          DS[0][i] * DS[1][j] / 3 );
+                          reduction::template add<parallelism>(temp_W[idx][0], flux_factor[0] * W_x);
+                          reduction::template add<parallelism>(temp_W[idx][1], flux_factor[1] * W_y);
+                          reduction::template add<parallelism>(temp_W[idx][2], flux_factor[2] * W_z);
+                        }
+                    }
+                }
+            }
         }
         
         template <class particle, class TempArr, class S_Info>
@@ -131,19 +240,31 @@ namespace AFFPiCS
                                            const S_Info &info       ) const
         {
           //Border conditions will always be tricky and entail branching...
+          
+          if (!part.is_alive(info))
+          //Dead particles are always considered to be at the border (see is_border),
+          //so they only need to be skipped here.
+            {
+              return;
+            }
                     
           FLType time_to_border = -1;
           
+          const vector_type<FLType, num_dims> vel = part.vel(info);
+          const vector_type<indexer, num_dims> cell = part.cell(info);
+          const vector_type<FLType, num_dims> pos = part.pos(info);
+          //Computed only once, since they are used for every dimension and neighbour.
+          
           for (indexer j = 0; j < info.dimensions(); ++j)
             {
               FLType new_time = -1;
-              if (part.vel(info)[j] > 0)
+              if (vel[j] > 0)
                 {
-                  new_time = (info.num_cells(j) - part.cell(info)[j] - part.pos(info)[j]) / part.vel(info)[j];
+                  new_time = (info.num_cells(j) - cell[j] - pos[j]) / vel[j];
                 }
-              else if (part.vel(info)[j] < 0)
+              else if (vel[j] < 0)
                 {
-                  new_time = (part.cell(info)[j] + part.pos(info)[j]) / part.vel(info)[j];
+                  new_time = (cell[j] + pos[j]) / vel[j];
                 }
                 
               if (new_time >= 0 && ( new_time < time_to_border || time_to_border < 0 ) )
@@ -164,26 +285,33 @@ namespace AFFPiCS
           //and thus we just need to compute W as usual and don't worry about anything else.
             {
               info.template for_all_neighbours<true>( info.template particle_cell_radius<particle>(part) + 1,
-                                                       part.cell(info), neighbour_functor{},
-                                                       part, temp_W, dt, info );
+                                                       cell, neighbour_functor{},
+                                                       part, vel, temp_W, dt, info );
             }
           else
             {
               //First, we accumulate W for the particle to travel towards the boundary
               info.template for_all_neighbours<true>( info.template particle_cell_radius<particle>(part) + 1,
-                                                       part.cell(info), neighbour_functor{},
-                                                       part, temp_W, time_to_border, info );
-              particle temp = part;
-              temp.set_pos(temp.pos(info) + time_to_border * temp.vel(info), info);
+                                                       cell, neighbour_functor{},
+                                                       part, vel, temp_W, time_to_border, info );
+              particle_value<particle> temp = part;
+              //If part is a proxy, we must not change the actual particle.
+              temp.set_pos(pos + time_to_border * vel, info);
               
               info.boundary_particles(temp, true);
               
+              if (!temp.is_alive(info))
+              //The particle has left the system.
+                {
+                  return;
+                }
+              
               //As a good approximation, we disregard the possibility
               //that the particle, after being treated according to the boundary conditions,
               //will reach the border again this timestep.
               info.template for_all_neighbours<true>( info.template particle_cell_radius<particle>(part) + 1,
                                                        temp.cell(info), neighbour_functor{},
-                                                       temp, temp_W, dt - time_to_border, info );
+                                                       temp, temp.vel(info), temp_W, dt - time_to_border, info );
               
             }
           
@@ -191,6 +319,54 @@ namespace AFFPiCS
         
         public:
         
+        /*!
+          \brief Checks if the particle \p part (of type \p particle) is close enough to the borders of the system
+                 for its contribution to the currents to need the boundary conditions.
+        */
+        template <class particle, class PartT, class S_Info>
+        CUDA_HOS_DEV static bool is_border(const PartT& part, const S_Info &info)
+        {
+          const indexer radius = info.template particle_cell_radius<particle>(particle{}) + 1;
+          
+          const vector_type<indexer, num_dims> cell = part.cell(info);
+          
+          for (indexer j = 0; j < cell.size(); ++j)
+            {
+              if (cell[j] < radius || cell[j] >= info.num_cells(j) - radius)
+                {
+                  return true;
+                }
+            }
+          return false;
+        }
+        
+        template <class particle, class PartT, class TempArr, class S_Info>
+        CUDA_HOS_DEV void interior(const PartT& part,
+                                   TempArr& temp_W,
+                                   const FLType dt,
+                                   const S_Info &info      ) const
+        {
+          if constexpr (SystemDefinitions::separable_shape_v<S_Info, particle>)
+            {
+              const indexer radius = info.template particle_cell_radius<particle>(particle{}) + 1;
+              if (radius <= Defaults::separable_max_radius + 1)
+                {
+                  deposit_interior_separable(part, temp_W, dt, info, radius);
+                  return;
+                }
+            }
+          deposit_interior(part, temp_W, dt, info);
+        }
+        
+        template <class PartT, class TempArr, class S_Info>
+        CUDA_HOS_DEV void border(const PartT& part,
+                                 TempArr& temp_W,
+                                 const FLType dt,
+                                 const S_Info &info      ) const
+        {
+          deposit_border(part, temp_W, dt, info);
+        }
+        
         template <class PartArr, class TempArr, class S_Info>
         CUDA_HOS_DEV void operator() (const PartArr& parts,
                                       const indexer i,
@@ -199,43 +375,71 @@ namespace AFFPiCS
                                       const S_Info &info      ) const
         {
           using particle = g24_lib::value_type<PartArr>;
-          const indexer radius = info.template particle_cell_radius<particle>(particle{}) + 1;
-          
-          bool is_border = false;
           
-          for (indexer j = 0; j < parts[i].cell(info).size(); ++j)
-            {
-              if (parts[i].cell(info)[j] < radius || parts[i].cell(info)[j] >= info.num_cells(j) - radius)
-                {
-                  is_border = true;
-                  break;
-                }
-            }
-            
           //Though the Esirkepov method's formulation is essentially branchless,
           //we need to account for possible boundary conditions,
           //hence this check for the cells that are at the borders of the system.
           //
-          //Possible (slightly more complex) alternative,
-          //possibly better suited to GPU parallelization:
-          //first do a loop over all particles that we know for sure are inside,
-          //only then do for those outside.
-          //This is admitting the particle array is sorted,
-          //which would also be an important improvement
-          //in the GPU case for memory coalescence.
-          //(And even in the CPU case it might bring benefits...)
+          //When possible, the depositer separates the interior and border particles beforehand
+          //(see interior_W_functor and border_W_functor),
+          //so this is only used when that can't be done
+          //(namely when the particles are still changed in the same kernel).
           
-          if (is_border)
+          if (is_border<particle>(parts[i], info))
             {
-              deposit_border(parts[i], temp_W, dt, info);
+              border(parts[i], temp_W, dt, info);
             }
           else
             {
-              deposit_interior(parts[i], temp_W, dt, info);
+              interior<particle>(parts[i], temp_W, dt, info);
             }
         }
       };
       
+      template <class parallelism>
+      struct border_check_functor
+      {
+        template <class PartArr, class S_Info>
+        CUDA_HOS_DEV bool operator() (const PartArr& parts, const indexer i, const S_Info &info) const
+        {
+          return calc_W_functor<parallelism>::template is_border<g24_lib::value_type<PartArr>>(parts[i], info);
+        }
+      };
+      
+      template <class parallelism>
+      struct interior_W_functor
+      //Goes over the particles whose indices are in ids,
+      //which must all be in the interior.
+      {
+        template <class IdxArr, class TempArr, class PartArr, class S_Info>
+        CUDA_HOS_DEV void operator() (const IdxArr& ids,
+                                      const indexer j,
+                                      TempArr& temp_W,
+                                      const PartArr& parts,
+                                      const FLType dt,
+                                      const S_Info &info      ) const
+        {
+          calc_W_functor<parallelism>{}.template interior<g24_lib::value_type<PartArr>>(parts[ids[j]], temp_W, dt, info);
+        }
+      };
+      
+      template <class parallelism>
+      struct border_W_functor
+      //Goes over the particles whose indices are in ids,
+      //which must all be at the borders.
+      {
+        template <class IdxArr, class TempArr, class PartArr, class S_Info>
+        CUDA_HOS_DEV void operator() (const IdxArr& ids,
+                                      const indexer j,
+                                      TempArr& temp_W,
+                                      const PartArr& parts,
+                                      const FLType dt,
+                                      const S_Info &info      ) const
+        {
+          calc_W_functor<parallelism>{}.border(parts[ids[j]], temp_W, dt, info);
+        }
+      };
+      
       struct calc_J_functor
       {
         template <class CurrArr, class TempArr, class S_Info>
@@ -247,23 +451,66 @@ namespace AFFPiCS
                                       const S_Info &info)const
         {
           const auto cell = info.to_cell(idx);
+          auto && J = currents[idx];
+          //Looked up only once, since it may need to be translated to a padded index.
+          if constexpr (has_ghost_cells<TempArr>::value)
+          //The ghost cells already hold what the boundary conditions would give.
+            {
+              for (indexer dim = 0; dim < info.dimensions(); ++dim)
+                {
+                  for (indexer j = -radius; j <= radius; ++j)
+                    {
+                      J += g24_lib::sign(j) * temp_W.at(cell.add(dim, j));
+                    }
+                }
+              return;
+            }
+          else if constexpr (has_planar_components<CurrArr>::value && has_planar_components<TempArr>::value)
+            {
+              bool interior = true;
+              vector_type<indexer, num_dims> strides;
+              for (indexer dim = 0; dim < info.dimensions(); ++dim)
+                {
+                  interior = interior && cell[dim] >= radius && cell[dim] + radius < info.num_cells(dim);
+                  strides[dim] = info.to_index(cell.add(dim, 1)) - idx;
+                }
+              if (interior)
+              //Each component is summed from its own array,
+              //so consecutive cells access memory with unit stride.
+                {
+                  for (indexer c = 0; c < CurrArr::num_components; ++c)
+                    {
+                      const auto & W_c = temp_W.component(c);
+                      FLType sum = 0;
+                      for (indexer dim = 0; dim < info.dimensions(); ++dim)
+                        {
+                          for (indexer j = -radius; j <= radius; ++j)
+                            {
+                              sum += g24_lib::sign(j) * W_c[idx + j * strides[dim]];
+                            }
+                        }
+                      currents.component(c)[idx] += sum;
+                    }
+                  return;
+                }
+            }
           for (indexer dim = 0; dim < info.dimensions(); ++dim)
             {
               indexer j;
               for (j = -radius; j <= radius && cell[dim] + j < 0; ++j)
                 {
-                  currents[idx] += g24_lib::sign(j) * info.boundary_J(cell.add(dim, j), temp_W);
+                  J += g24_lib::sign(j) * info.boundary_J(cell.add(dim, j), temp_W);
                   //Since the currents are linear combinations of W, 
                   //the same boundary conditions (namely if periodic)
                   //should apply.
                 }
               for (; j <= radius && cell[dim] + j < info.num_cells(dim); ++j)
                 {
-                  currents[idx] += g24_lib::sign(j) * temp_W[info.to_index(cell.add(dim, j))];
+                  J += g24_lib::sign(j) * temp_W[info.to_index(cell.add(dim, j))];
                 }
               for (; j <= radius; ++j)
                 {
-                  currents[idx] += g24_lib::sign(j) * info.boundary_J(cell.add(dim, j), temp_W);
+                  J += g24_lib::sign(j) * info.boundary_J(cell.add(dim, j), temp_W);
                 }
             }
         }
@@ -278,6 +525,27 @@ namespace AFFPiCS
         }
       };
       
+      template <class parallelism, class Before, class After>
+      struct fused_W_functor
+      //Accumulates W for a particle in between whatever
+      //the other stages of the simulation need to do to it,
+      //so that each particle is only brought from memory once.
+      {
+        template <class PartArr, class TempArr, class S_Info>
+        CUDA_HOS_DEV void operator() (PartArr& parts,
+                                      const indexer i,
+                                      TempArr& temp_W,
+                                      const Before& before,
+                                      const After& after,
+                                      const FLType dt,
+                                      const S_Info &info      ) const
+        {
+          before(parts, i);
+          calc_W_functor<parallelism>{}(parts, i, temp_W, dt, info);
+          after(parts, i);
+        }
+      };
+      
       private:
       template <class parallelism>
       using particle_storage_type = particle_storage<parallelism, particles<num_dims>...>;
@@ -287,39 +555,78 @@ namespace AFFPiCS
       template <class parallelism> struct storage
       {
         typename parallelism::kernel_size_type calc_W_kernel[sizeof...(particles)],
-                                               calc_J_kernel[sizeof...(particles)],
+                                               calc_J_kernel,
                                                W_J_reset_kernel;
         
         current_holder<parallelism, num_dims> temp_W;
         
+        private_buffer_holder<parallelism, current_type<num_dims>> buffers;
+        //Only used if reduction::private_buffers.
+        
+        indexer radii[sizeof...(particles)];
+        //The radius used in calc_J for each species.
+        
+        std::vector<indexer> group_radii;
+        //The different values in radii.
+        //Since the currents are linear in W, all species with the same radius
+        //can be accumulated in temp_W and go through calc_J together.
+        
+        index_partitioner<parallelism> partitioner;
+        
+        typename index_partitioner<parallelism>::index_array interior_ids, border_ids;
+        //The indices of the particles (of the species being deposited)
+        //that are in the interior and at the borders of the system.
+        
+        indexer calc_W_size[sizeof...(particles)];
+        //The number of interior particles for which calc_W_kernel was estimated.
+        
+        /*!
+          \brief Estimates the kernel for the loop over the \p num interior particles of the species with index \p idx,
+                 unless it was already estimated for that number.
+        */
+        template <indexer idx>
+        void estimate_interior_kernel(const indexer num)
+        {
+          using part = std::tuple_element_t<idx, std::tuple<particles<num_dims>...>>;
+          if (num != calc_W_size[idx])
+            {
+              calc_W_kernel[idx] = parallelism::template estimate_loop_kernel_size
+                                      < typename index_partitioner<parallelism>::index_array,
+                                        Tracing::traced_t<interior_W_functor<parallelism>>,
+                                        current_holder<parallelism, num_dims>,
+                                        particle_holder<parallelism, part>,
+                                        FLType, system_info                     >
+                                    (num);
+              calc_W_size[idx] = num;
+            }
+        }
+        
         private:
         
         template <indexer idx, class part, class ... parts>
-        void initialize_in(const particle_storage_type<parallelism> &part_store)
+        void initialize_in(const particle_storage_type<parallelism> &part_store, const system_info& info)
         {
-          initialize_single<idx, part>(part_store);
+          initialize_single<idx, part>(part_store, info);
           if constexpr (sizeof...(parts) > 0)
             {
-              initialize_in<idx + 1, parts...>(part_store);
+              initialize_in<idx + 1, parts...>(part_store, info);
             }
         }
         
         template <indexer idx, class part>
-        void initialize_single(const particle_storage_type<parallelism> &part_store)
+        void initialize_single(const particle_storage_type<parallelism> &part_store, const system_info& info)
         {
-          calc_W_kernel[idx] = parallelism::template estimate_loop_kernel_size
-                                  < particle_holder<parallelism, part>,
-                                    calc_W_functor<parallelism>,
-                                    current_holder<parallelism, num_dims>,
-                                    FLType, system_info                     >
-                                (part_store.template get_particles<part>().size());
-                                
-          calc_J_kernel[idx] = parallelism::template estimate_loop_kernel_size
-                                  < current_holder<parallelism, num_dims>,
-                                    calc_J_functor,
-                                    current_holder<parallelism, num_dims>,
-                                    FLType, indexer, system_info                     >
-                                (temp_W.size());
+          calc_W_size[idx] = -1;
+          //Estimated once the interior particles are known.
+          
+          radii[idx] = info.template particle_cell_radius<part>(part{}) + 1;
+          
+          check_ghost_reach<current_holder<parallelism, num_dims>>(radii[idx]);
+          
+          if (std::find(group_radii.begin(), group_radii.end(), radii[idx]) == group_radii.end())
+            {
+              group_radii.push_back(radii[idx]);
+            }
         }
         
         public:
@@ -330,10 +637,24 @@ namespace AFFPiCS
         {
           temp_W.resize(currents.size());
           
-          initialize_in<0, particles<num_dims>...>(part_store);
+          if constexpr (reduction::private_buffers)
+            {
+              buffers.resize(reduction::chunks, temp_W);
+            }
+          
+          group_radii.clear();
+          
+          initialize_in<0, particles<num_dims>...>(part_store, info);
           
           W_J_reset_kernel = parallelism::template estimate_loop_kernel_size
-                                    <current_holder<parallelism, num_dims>, W_J_reset_functor>
+                                    <current_holder<parallelism, num_dims>, Tracing::traced_t<W_J_reset_functor>>
+                                (currents.size());
+          
+          calc_J_kernel = parallelism::template estimate_loop_kernel_size
+                                  < current_holder<parallelism, num_dims>,
+                                    Tracing::traced_t<calc_J_functor>,
+                                    current_holder<parallelism, num_dims>,
+                                    FLType, indexer, system_info                     >
                                 (currents.size());
         }
         
@@ -351,42 +672,120 @@ namespace AFFPiCS
      
       private:
       
-      template <indexer idx, class parallelism, class part, class ... parts>
-      static void deposit_impl(storage<parallelism> &store,
-                               current_holder<parallelism, num_dims> &currents,
-                               const particle_storage_type<parallelism>& part_storage,
-                               const FLType dt,
-                               const system_info& info)
+      template <indexer idx, class parallelism, class Functor, class PartStore, class ... Args>
+      static void accumulate_group(storage<parallelism> &store,
+                                   PartStore& part_storage,
+                                   const indexer radius,
+                                   bool &first,
+                                   const FLType dt,
+                                   const system_info& info,
+                                   const Args& ... args)
+      //Accumulates W in store.temp_W (or in the private buffers) for all the species
+      //whose radius is radius, starting with the one with index idx.
+      //Functor is called with the particle array, the index, the W array, args..., dt and info.
       {
-        deposit_impl_single<idx, parallelism, part>(store, currents, part_storage, dt, info);
-        if constexpr (sizeof...(parts) > 0)
+        if (store.radii[idx] == radius)
           {
-            deposit_impl<idx + 1, parallelism, parts...>(store, currents, part_storage, dt, info);
+            using part = std::tuple_element_t<idx, std::tuple<particles<num_dims>...>>;
+            
+            auto &parts = part_storage.template get_particles<part>();
+            
+            if constexpr (std::is_same_v<Functor, calc_W_functor<parallelism>>)
+            //The particles can be separated into interior and border ones beforehand,
+            //so that the (vast majority of) interior ones are handled without any branching
+            //and only the border ones need to go through the boundary conditions.
+              {
+                store.partitioner.template partition<border_check_functor<parallelism>>
+                                    (parts, store.border_ids, store.interior_ids, info);
+                
+                store.template estimate_interior_kernel<idx>(store.interior_ids.size());
+                
+                if constexpr (reduction::private_buffers)
+                  {
+                    store.buffers.template accumulate<interior_W_functor<parallelism>>
+                                    (store.interior_ids, first, parts, dt, info);
+                    store.buffers.template accumulate<border_W_functor<parallelism>>
+                                    (store.border_ids, false, parts, dt, info);
+                  }
+                else
+                  {
+                    parallelism::loop( store.calc_W_kernel[idx], store.interior_ids,
+                                       Tracing::trace("Esirkepov W (interior)", interior_W_functor<parallelism>{}),
+                                       store.temp_W, parts, dt, info );
+                    parallelism::loop( store.border_ids, Tracing::trace("Esirkepov W (border)", border_W_functor<parallelism>{}),
+                                       store.temp_W, parts, dt, info );
+                  }
+              }
+            else if constexpr (reduction::private_buffers)
+              {
+                store.buffers.template accumulate<Functor>(parts, first, args..., dt, info);
+              }
+            else
+              {
+                parallelism::loop( parts, Tracing::trace("Esirkepov W", Functor{}), store.temp_W, args..., dt, info );
+              }
+            
+            first = false;
+          }
+        
+        if constexpr (idx + 1 < sizeof...(particles))
+          {
+            accumulate_group<idx + 1, parallelism, Functor>(store, part_storage, radius, first, dt, info, args...);
           }
       }
       
-      template <indexer idx, class parallelism, class part>
-      static void deposit_impl_single(storage<parallelism> &store,
-                                      current_holder<parallelism, num_dims> &currents,
-                                      const particle_storage_type<parallelism>& part_storage,
-                                      const FLType dt,
-                                      const system_info& info)
+      template <class parallelism, class Functor, class PartStore, class ... Args>
+      static void deposit_impl(storage<parallelism> &store,
+                               current_holder<parallelism, num_dims> &currents,
+                               PartStore& part_storage,
+                               const FLType dt,
+                               const system_info& info,
+                               const Args& ... args)
+      //Functor is called with the particle array, the index, the W array, args..., dt and info.
       {
-        parallelism::loop( store.W_J_reset_kernel, store.temp_W, W_J_reset_functor{});
-        
-        parallelism::loop( store.calc_W_kernel[idx], part_storage.template get_particles<part>(),
-                           calc_W_functor<parallelism>{}, store.temp_W, dt, info                  );
+        parallelism::loop( store.W_J_reset_kernel, currents, Tracing::trace("Esirkepov reset J", W_J_reset_functor{}) );
         
-        parallelism::loop( store.calc_J_kernel[idx], currents, calc_J_functor{},
-                           store.temp_W, dt, info.template particle_cell_radius<part>(part{}) + 1, info );
+        for (const indexer radius : store.group_radii)
+          {
+            if constexpr (!reduction::private_buffers)
+              {
+                parallelism::loop( store.W_J_reset_kernel, store.temp_W, Tracing::trace("Esirkepov reset W", W_J_reset_functor{}) );
+              }
+            
+            bool first = true;
+            
+            accumulate_group<0, parallelism, Functor>(store, part_storage, radius, first, dt, info, args...);
+            
+            if constexpr (reduction::private_buffers)
+              {
+                store.buffers.reduce(store.temp_W);
+              }
+            
+            update_J_ghosts(store.temp_W, info);
+            
+            parallelism::loop( store.calc_J_kernel, currents, Tracing::trace("Esirkepov J", calc_J_functor{}),
+                               store.temp_W, dt, radius, info );
+          }
       }
       
       public:
       
+      /*!
+        \brief Signals that `deposit_fused` is available.
+      */
+      static constexpr bool fusable = true;
+      
       struct results {};
       //There's no need to return anything from here.
       //Might be useful for debugging, but later...
       
+      /*!
+        \brief Deposits the currents of all the species.
+        
+        \remark The contributions of all the species with the same shape radius
+                are accumulated together, so the (grid-sized) computation of the currents
+                is done once per different radius rather than once per species.
+      */
       template <class parallelism>
       static results deposit(storage<parallelism> &store,
                              current_holder<parallelism, num_dims> &currents,
@@ -394,11 +793,47 @@ namespace AFFPiCS
                              const FLType dt,
                              const system_info& info)
       {
-        parallelism::loop( store.W_J_reset_kernel, currents, W_J_reset_functor{} );
-        deposit_impl<0, parallelism, particles<num_dims>...>(store, currents, part_storage, dt, info);
+        deposit_impl<parallelism, calc_W_functor<parallelism>>(store, currents, part_storage, dt, info);
+        return results{};
+      }
+      
+      /*!
+        \brief Deposits the currents while also applying \p before and \p after
+               to each particle, in the same kernel, respectively before and after
+               its contribution to the currents is computed.
+        
+        \param before, after Functors called as `before(particle_array, i)` and `after(particle_array, i)`.
+        
+        \remark This allows the particles to be moved and pushed
+                in a single pass through the particle arrays,
+                which is relevant when the simulation is limited by memory bandwidth.
+      */
+      template <class parallelism, class Before, class After>
+      static results deposit_fused(storage<parallelism> &store,
+                                   current_holder<parallelism, num_dims> &currents,
+                                   particle_storage_type<parallelism>& part_storage,
+                                   const FLType dt,
+                                   const system_info& info,
+                                   const Before& before,
+                                   const After& after)
+      {
+        deposit_impl<parallelism, fused_W_functor<parallelism, Before, After>>
+                      (store, currents, part_storage, dt, info, before, after);
         return results{};
       }
     };
+    
+    template <class system_info, indexer num_dims, template <indexer> class ... particles>
+    using Esirkepov = EsirkepovWithReduction<Reductions::Atomic, system_info, num_dims, particles...>;
+    
+    /*!
+      \brief Esirkepov deposition with bitwise reproducible results
+             and no contention between threads, at the cost of some extra memory.
+      
+      \sa Reductions::PrivateBuffers
+    */
+    template <class system_info, indexer num_dims, template <indexer> class ... particles>
+    using EsirkepovDeterministic = EsirkepovWithReduction<Reductions::PrivateBuffers<>, system_info, num_dims, particles...>;
   }
 }
 
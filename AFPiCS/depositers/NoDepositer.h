@@ -10,6 +10,7 @@
 */
 
 #include "../header.h"
+#include "../utilities/planar_fields.h"
 #include "../utilities/particle_storage.h"
 
 namespace AFFPiCS
@@ -45,6 +46,8 @@ namespace AFFPiCS
         
       };
      
+      static constexpr bool fusable = false;
+     
       struct results {};
       //There's no need to return anything from here.
       //Might be useful for debugging, but later...
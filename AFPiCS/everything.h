@@ -5,11 +5,14 @@
 #include "depositers/Esirkepov.h"
 #include "depositers/NoDepositer.h"
 #include "evolvers/FDTDEvolver.h"
+#include "evolvers/FDTDTiledEvolver.h"
 #include "evolvers/NoEvolver.h"
 #include "particle_shapes/polynomial.h"
 #include "particle_shapes/splines.h"
 #include "particles/particle_base.h"
 #include "particles/particle_simple.h"
+#include "particles/particle_cached_gamma.h"
+#include "particles/particle_weighted.h"
 #include "particles/common_particles.h"
 #include "pushers/simple_pusher.h"
 #include "pushers/Boris.h"
@@ -17,14 +20,32 @@
 #include "pushers/Vay.h"
 #include "pushers/Boris.h"
 #include "pushers/NoPusher.h"
+#include "sources/maxwell_juttner.h"
+#include "sources/box_sampling.h"
+#include "sources/cell_injection.h"
+#include "sources/BoxLoader.h"
+#include "sources/FaceInjector.h"
+#include "sources/ProfileLoader.h"
 #include "system_info/system_info_base.h"
 #include "system_info/system_info_constant.h"
 #include "system_info/system_info_maker.h"
+#include "system_info/absorbing_boundary_conditions.h"
 #include "system_info/periodic_boundary_conditions.h"
 #include "system_info/reflecting_boundary_conditions.h"
 #include "system_info/symbolic_shapes.h"
 #include "system_info/symbolic_shapes_simple.h"
 #include "system_info/yee_cell.h"
+#include "utilities/ghost_cells.h"
+#include "utilities/particle_reservoir.h"
+#include "utilities/particle_soa.h"
+#include "utilities/planar_fields.h"
+#include "utilities/population_control.h"
+#include "utilities/random.h"
+#include "utilities/reductions.h"
+#include "utilities/simd.h"
+#include "utilities/stream_compaction.h"
+#include "utilities/timing.h"
+#include "utilities/tracing.h"
 
 #include "simul.h"
 
@@ -12,6 +12,9 @@
 */
 
 #include "../header.h"
+#include "../utilities/planar_fields.h"
+#include "../utilities/ghost_cells.h"
+#include "../utilities/tracing.h"
 
 namespace AFFPiCS
 {
@@ -33,7 +36,9 @@ namespace AFFPiCS
                                        const FLType dt,
                                        const S_Info& info        ) const
         {
-          B_fields[i] = B_fields[i] - info.E_curl(E_fields, i) * dt;
+          auto && B = B_fields[i];
+          //Looked up only once, since it may need to be translated to a padded index.
+          B = B - info.E_curl(E_fields, i) * dt;
         }
       };
       
@@ -47,7 +52,8 @@ namespace AFFPiCS
                                        const FLType dt,
                                        const S_Info& info          ) const
         {
-          E_fields[i] = E_fields[i] + (info.B_curl(B_fields, i)/info.epsilon(i)/info.mu(i) - currents[i]/info.epsilon(i)) * dt;
+          auto && E = E_fields[i];
+          E = E + (info.B_curl(B_fields, i)/info.epsilon(i)/info.mu(i) - currents[i]/info.epsilon(i)) * dt;
         }
       };
       public:
@@ -55,6 +61,14 @@ namespace AFFPiCS
         {
           typename parallelism::kernel_size_type E_kernel, B_kernel;
           
+          bool staggered = false;
+          //If true, the last half timestep update of the magnetic field
+          //is merged with the first one of the next step.
+          
+          FLType pending_B = 0;
+          //How long the magnetic field must still be evolved for
+          //to be synchronized with the electric field.
+          
           void initialize(const E_field_holder<parallelism, num_dims> &E_fields,
                           const B_field_holder<parallelism, num_dims> &B_fields,
                           const current_holder<parallelism, num_dims> &currents,
@@ -62,15 +76,16 @@ namespace AFFPiCS
           {
             E_kernel = parallelism::template estimate_loop_kernel_size
                                       < E_field_holder<parallelism, num_dims>,
-                                        E_Evolve_Functor,
+                                        Tracing::traced_t<E_Evolve_Functor>,
                                         B_field_holder<parallelism, num_dims>,
                                         current_holder<parallelism, num_dims>,
                                         FLType, system_info                     > (E_fields.size());
             B_kernel = parallelism::template estimate_loop_kernel_size
                                       < B_field_holder<parallelism, num_dims>,
-                                        B_Evolve_Functor,
+                                        Tracing::traced_t<B_Evolve_Functor>,
                                         E_field_holder<parallelism, num_dims>,
                                         FLType, system_info                     > (E_fields.size());
+            //pending_B is kept: any pending update must still be done (see `Simulation::initialize`).
           }
           
           
@@ -82,9 +97,18 @@ namespace AFFPiCS
           
           template <class stream> void load(stream &s, bool binary = Defaults::data_i_o_as_binary)
           {
+            pending_B = 0;
+            //The fields are always saved synchronized.
           }
         };
         
+        /*!
+          \brief Signals that the magnetic field can be left half a timestep behind
+                 at the end of each step (see `storage::staggered`),
+                 in which case `synchronize` must be called before it is used.
+        */
+        static constexpr bool staggerable = true;
+        
         struct results {};
         //There's no need to return anything from here.
         //Might be useful for debugging, but later...
@@ -97,11 +121,42 @@ namespace AFFPiCS
                                 const FLType dt,
                                 const system_info &info                                 )
         {
-          parallelism::loop(store.B_kernel, B_fields, B_Evolve_Functor{}, E_fields, dt/2, info);
-          parallelism::loop(store.E_kernel, E_fields, E_Evolve_Functor{}, B_fields, currents, dt, info);
-          parallelism::loop(store.B_kernel, B_fields, B_Evolve_Functor{}, E_fields, dt/2, info);
+          parallelism::loop(store.B_kernel, B_fields, Tracing::trace("FDTD B", B_Evolve_Functor{}), E_fields, store.pending_B + dt/2, info);
+          update_B_ghosts(B_fields, info);
+          //Since the electric field has not changed since the end of the last step,
+          //any pending update can be done together with this one.
+          store.pending_B = 0;
+          parallelism::loop(store.E_kernel, E_fields, Tracing::trace("FDTD E", E_Evolve_Functor{}), B_fields, currents, dt, info);
+          update_E_ghosts(E_fields, info);
+          if (store.staggered)
+            {
+              store.pending_B = dt/2;
+            }
+          else
+            {
+              parallelism::loop(store.B_kernel, B_fields, Tracing::trace("FDTD B", B_Evolve_Functor{}), E_fields, dt/2, info);
+              update_B_ghosts(B_fields, info);
+            }
           return results{};
         }
+        
+        /*!
+          \brief Evolves the magnetic field by whatever is pending
+                 so that it corresponds to the same time as the electric field.
+        */
+        template <class parallelism>
+        static void synchronize ( storage<parallelism> &store,
+                                  const E_field_holder<parallelism, num_dims> &E_fields,
+                                  B_field_holder<parallelism, num_dims> &B_fields,
+                                  const system_info &info                                 )
+        {
+          if (store.pending_B != 0)
+            {
+              parallelism::loop(store.B_kernel, B_fields, Tracing::trace("FDTD B sync", B_Evolve_Functor{}), E_fields, store.pending_B, info);
+              update_B_ghosts(B_fields, info);
+              store.pending_B = 0;
+            }
+        }
     };
   }
 }
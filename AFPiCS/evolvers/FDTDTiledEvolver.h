@@ -0,0 +1,326 @@
+#ifndef AFFPICS_EVOLVERS_FDTD_TILED_EVOLVER
+#define AFFPICS_EVOLVERS_FDTD_TILED_EVOLVER
+
+
+/*!
+  \file FDTDTiledEvolver.h
+  
+  \brief Evolves the fields according to the same finite-difference time-domain method
+         as `Evolvers::FDTD`, but going over the grid in cache-sized tiles
+         and accessing the neighbouring cells through linear strides.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include "../utilities/planar_fields.h"
+#include "../utilities/ghost_cells.h"
+#include "../utilities/tracing.h"
+#include "../utilities/helpers.h"
+#include <cmath>
+#include <algorithm>
+
+namespace AFFPiCS
+{
+  namespace Evolvers
+  {
+    /*!
+      \brief Evolves the fields just like `FDTD`, but the grid is split into tiles
+             of about `Defaults::fdtd_tile_cells` cells and, except for the cells
+             at the borders of the system, the curls are computed directly
+             from the neighbouring elements of the arrays, without going through
+             `to_cell` and the boundary conditions.
+      
+      \pre The system info must use the default (centered) curls
+           and its linear cell indices must be affine in the cells
+           (as with any row- or column-major ordering), since the strides
+           are computed once at the start.
+    */
+    template <class system_info, indexer num_dims>
+    class FDTDTiled
+    {
+      struct tile_geometry
+      {
+        vector_type<indexer, num_dims> strides;
+        //The difference in linear index between neighbouring cells in each dimension.
+        
+        indexer order[num_dims];
+        //The dimensions, sorted by decreasing stride, so that the innermost loop is contiguous.
+        
+        vector_type<indexer, num_dims> cells;
+        //The number of cells in each dimension.
+        
+        indexer length;
+        //The number of cells of a tile in each dimension.
+        
+        template <indexer level, class Func>
+        CUDA_HOS_DEV void loop_helper(const vector_type<indexer, num_dims> &first,
+                                      const vector_type<indexer, num_dims> &last,
+                                      vector_type<indexer, num_dims> &cell,
+                                      const indexer idx,
+                                      const Func &func) const
+        {
+          if constexpr (level == num_dims)
+            {
+              func(idx, cell);
+            }
+          else
+            {
+              const indexer d = order[level];
+              for (cell[d] = first[d]; cell[d] < last[d]; ++cell[d])
+                {
+                  loop_helper<level + 1>(first, last, cell, idx + (cell[d] - first[d]) * strides[d], func);
+                }
+            }
+        }
+        
+        /*!
+          \brief Calls `func(idx, cell, border)` for every cell of the tile
+                 whose first cell is \p first_cell, where `border` is true
+                 if the cell is at the borders of the system.
+        */
+        template <class Func, class S_Info>
+        CUDA_HOS_DEV void for_tile(const indexer first_cell, const S_Info &info, const Func &func) const
+        {
+          const vector_type<indexer, num_dims> first = info.to_cell(first_cell);
+          vector_type<indexer, num_dims> last, cell;
+          
+          bool interior = true;
+          
+          for (indexer d = 0; d < num_dims; ++d)
+            {
+              last[d] = (first[d] + length < cells[d] ? first[d] + length : cells[d]);
+              interior = interior && first[d] > 0 && last[d] < cells[d];
+            }
+          
+          if (interior)
+            {
+              loop_helper<0>(first, last, cell, first_cell,
+                             [&](const indexer idx, const vector_type<indexer, num_dims> &c)
+                             { func(idx, c, false); }                                        );
+            }
+          else
+            {
+              loop_helper<0>(first, last, cell, first_cell,
+                             [&](const indexer idx, const vector_type<indexer, num_dims> &c)
+                             {
+                               bool border = false;
+                               for (indexer d = 0; d < num_dims; ++d)
+                                 {
+                                   border = border || c[d] == 0 || c[d] == cells[d] - 1;
+                                 }
+                               func(idx, c, border);
+                             }                                                               );
+            }
+        }
+      };
+      
+      struct B_Evolve_Functor
+      {
+        template <class TileArr, class B_arr, class E_arr, class S_Info>
+        CUDA_HOS_DEV void operator() ( const TileArr & tiles,
+                                       const indexer t,
+                                       B_arr & B_fields,
+                                       const E_arr & E_fields,
+                                       const FLType dt,
+                                       const S_Info& info,
+                                       const tile_geometry &geom ) const
+        {
+          geom.for_tile(tiles[t], info,
+                        [&](const indexer i, const vector_type<indexer, num_dims> &cell, const bool border)
+                        {
+                          if (border)
+                            {
+                              B_fields[i] = B_fields[i] - info.E_curl(E_fields, cell) * dt;
+                            }
+                          else if constexpr (has_planar_components<B_arr>::value && has_planar_components<E_arr>::value)
+                          //Each component is read and written in its own array,
+                          //so the innermost loop of the tile goes through them with unit stride.
+                            {
+                              const B_field_type<num_dims> E_c = strided_component_curl<magnetic_field_dimensions<num_dims>()>
+                                                                   (i, E_fields, geom.strides, info.cell_sizes());
+                              for (indexer d = 0; d < E_c.size(); ++d)
+                                {
+                                  B_fields.component(d)[i] -= E_c[d] * dt;
+                                }
+                            }
+                          else
+                            {
+                              B_fields[i] = B_fields[i] -
+                                            strided_curl<magnetic_field_dimensions<num_dims>()>
+                                                  (i, E_fields, geom.strides, info.cell_sizes()) * dt;
+                            }
+                        }                                                                             );
+        }
+      };
+      
+      struct E_Evolve_Functor
+      {
+        template <class TileArr, class E_arr, class B_arr, class J_arr, class S_Info>
+        CUDA_HOS_DEV void operator() ( const TileArr & tiles,
+                                       const indexer t,
+                                       E_arr & E_fields,
+                                       const B_arr & B_fields,
+                                       const J_arr & currents,
+                                       const FLType dt,
+                                       const S_Info& info,
+                                       const tile_geometry &geom ) const
+        {
+          geom.for_tile(tiles[t], info,
+                        [&](const indexer i, const vector_type<indexer, num_dims> &cell, const bool border)
+                        {
+                          if constexpr ( has_planar_components<E_arr>::value &&
+                                         has_planar_components<B_arr>::value &&
+                                         has_planar_components<J_arr>::value    )
+                            {
+                              const E_field_type<num_dims> B_c = ( border ?
+                                                                   info.B_curl(B_fields, cell) :
+                                                                   strided_component_curl<electric_field_dimensions<num_dims>()>
+                                                                     (i, B_fields, geom.strides, info.cell_sizes()) );
+                              const FLType eps = info.epsilon(i), mu = info.mu(i);
+                              for (indexer d = 0; d < B_c.size(); ++d)
+                                {
+                                  E_fields.component(d)[i] += (B_c[d]/eps/mu - currents.component(d)[i]/eps) * dt;
+                                }
+                            }
+                          else
+                            {
+                              const E_field_type<num_dims> B_c = ( border ?
+                                                                   info.B_curl(B_fields, cell) :
+                                                                   strided_curl<electric_field_dimensions<num_dims>()>
+                                                                     (i, B_fields, geom.strides, info.cell_sizes()) );
+                              E_fields[i] = E_fields[i] + (B_c/info.epsilon(i)/info.mu(i) - currents[i]/info.epsilon(i)) * dt;
+                            }
+                        }                                                                                                   );
+        }
+      };
+      public:
+        template <class parallelism> struct storage
+        {
+          g24_lib::array_parallel<parallelism, indexer> tiles;
+          //The linear index of the first cell of each tile.
+          
+          tile_geometry geom;
+          
+          bool staggered = false;
+          //If true, the last half timestep update of the magnetic field
+          //is merged with the first one of the next step.
+          
+          FLType pending_B = 0;
+          //How long the magnetic field must still be evolved for
+          //to be synchronized with the electric field.
+          
+          void initialize(const E_field_holder<parallelism, num_dims> &E_fields,
+                          const B_field_holder<parallelism, num_dims> &B_fields,
+                          const current_holder<parallelism, num_dims> &currents,
+                          const system_info& info                                 )
+          {
+            using namespace std;
+            
+            const vector_type<indexer, num_dims> origin(0);
+            
+            for (indexer d = 0; d < num_dims; ++d)
+              {
+                geom.strides[d] = info.to_index(origin.add(d, 1)) - info.to_index(origin);
+                geom.order[d] = d;
+                geom.cells[d] = info.num_cells(d);
+              }
+            
+            sort(geom.order, geom.order + num_dims,
+                 [&](const indexer a, const indexer b){ return geom.strides[a] > geom.strides[b]; });
+            
+            geom.length = max(indexer(1), indexer(lround(pow(FLType(Defaults::fdtd_tile_cells), FLType(1)/num_dims))));
+            
+            vector_type<indexer, num_dims> num_tiles;
+            
+            for (indexer d = 0; d < num_dims; ++d)
+              {
+                num_tiles[d] = (geom.cells[d] + geom.length - 1) / geom.length;
+              }
+            
+            tiles.resize(num_tiles.multiply_all());
+            
+            for (indexer t = 0; t < tiles.size(); ++t)
+              {
+                vector_type<indexer, num_dims> cell;
+                indexer rest = t;
+                for (indexer d = 0; d < num_dims; ++d)
+                  {
+                    cell[d] = (rest % num_tiles[d]) * geom.length;
+                    rest /= num_tiles[d];
+                  }
+                tiles[t] = info.to_index(cell);
+              }
+            
+            //pending_B is kept: any pending update must still be done (see `Simulation::initialize`).
+          }
+          
+          
+          template <class stream> void save(stream &s, bool binary = Defaults::data_i_o_as_binary) const
+          {
+          
+          }
+          
+          
+          template <class stream> void load(stream &s, bool binary = Defaults::data_i_o_as_binary)
+          {
+            pending_B = 0;
+            //The fields are always saved synchronized.
+          }
+        };
+        
+        /*!
+          \brief Signals that the magnetic field can be left half a timestep behind
+                 at the end of each step (see `storage::staggered`),
+                 in which case `synchronize` must be called before it is used.
+        */
+        static constexpr bool staggerable = true;
+        
+        struct results {};
+        //There's no need to return anything from here.
+        //Might be useful for debugging, but later...
+        
+        template <class parallelism>
+        static results evolve ( storage<parallelism> &store,
+                                E_field_holder<parallelism, num_dims> &E_fields,
+                                B_field_holder<parallelism, num_dims> &B_fields,
+                                const current_holder<parallelism, num_dims> &currents,
+                                const FLType dt,
+                                const system_info &info                                 )
+        {
+          parallelism::loop(store.tiles, Tracing::trace("FDTDTiled B", B_Evolve_Functor{}), B_fields, E_fields, store.pending_B + dt/2, info, store.geom);
+          update_B_ghosts(B_fields, info);
+          //Any pending update is merged with this one, as in FDTD::evolve.
+          store.pending_B = 0;
+          parallelism::loop(store.tiles, Tracing::trace("FDTDTiled E", E_Evolve_Functor{}), E_fields, B_fields, currents, dt, info, store.geom);
+          update_E_ghosts(E_fields, info);
+          if (store.staggered)
+            {
+              store.pending_B = dt/2;
+            }
+          else
+            {
+              parallelism::loop(store.tiles, Tracing::trace("FDTDTiled B", B_Evolve_Functor{}), B_fields, E_fields, dt/2, info, store.geom);
+              update_B_ghosts(B_fields, info);
+            }
+          return results{};
+        }
+        
+        template <class parallelism>
+        static void synchronize ( storage<parallelism> &store,
+                                  const E_field_holder<parallelism, num_dims> &E_fields,
+                                  B_field_holder<parallelism, num_dims> &B_fields,
+                                  const system_info &info                                 )
+        {
+          if (store.pending_B != 0)
+            {
+              parallelism::loop(store.tiles, Tracing::trace("FDTDTiled B sync", B_Evolve_Functor{}), B_fields, E_fields, store.pending_B, info, store.geom);
+              update_B_ghosts(B_fields, info);
+              store.pending_B = 0;
+            }
+        }
+    };
+  }
+}
+
+#endif
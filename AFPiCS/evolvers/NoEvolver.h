@@ -11,6 +11,7 @@
 */
 
 #include "../header.h"
+#include "../utilities/planar_fields.h"
 
 namespace AFFPiCS
 {
@@ -40,6 +41,8 @@ namespace AFFPiCS
           }
         };
         
+        static constexpr bool staggerable = false;
+        
         struct results {};
         //There's no need to return anything from here.
         //Might be useful for debugging, but later...
@@ -13,6 +13,8 @@
 #include <string>
 #include <cmath>
 #include <utility>
+#include <type_traits>
+#include <limits>
 
 namespace AFFPiCS
 {
@@ -41,6 +43,99 @@ namespace AFFPiCS
     */
     inline static StrType file_extension = StrType(".dat");
     
+    /*! \brief The number of elements to which each of the component arrays
+               of particles stored as a structure of arrays is padded,
+               so that vectorized loops need no special treatment at the end.
+    */
+    inline static constexpr indexer soa_padding = 16;
+    
+    /*! \brief If more than this fraction of the particles has changed cells
+               since the last sort, an incremental sort falls back to a full one.
+    */
+    inline static constexpr FLType incremental_sort_threshold = 0.1;
+    
+    /*! \brief The default number of chunks (and thus private buffers)
+               used by `Reductions::PrivateBuffers`.
+    */
+    inline static constexpr indexer reduction_chunks = 16;
+    
+    /*! \brief The private buffers used by `Reductions::PrivateBuffers`
+               are padded to a multiple of this number of elements.
+    */
+    inline static constexpr indexer reduction_padding = 8;
+    
+    /*! \brief The largest shape radius (as given by `particle_cell_radius`)
+               for which the separable fast path in the Esirkepov deposition is used.
+    */
+    inline static constexpr indexer separable_max_radius = 4;
+    
+    /*! \brief The number of chunks in which arrays are split
+               when partitioning their indices in parallel.
+    */
+    inline static constexpr indexer compaction_chunks = 64;
+    
+    /*! \brief The (approximate) number of cells in each of the tiles
+               into which the grid is split by `Evolvers::FDTDTiled`.
+    */
+    inline static constexpr indexer fdtd_tile_cells = 4096;
+    
+    /*! \brief The number of ghost cells at each side of the system
+               in each dimension when `AFFPICS_GHOST_CELLS` is defined.
+        
+        \remark Must be at least the shape radius of the particles plus one,
+                since that is how far the gathers and the current computations reach
+                (checked when the pusher and the depositer are initialized, see `check_ghost_reach`).
+    */
+    inline static constexpr indexer ghost_cells = 4;
+    
+    /*! \brief The number of events kept for each thread when `AFFPICS_TRACING` is defined,
+               after which the oldest ones are overwritten.
+    */
+    inline static constexpr indexer trace_buffer_events = 16384;
+    
+    /*! \brief The largest number of threads whose events are output by `Tracing::dump`.
+    */
+    inline static constexpr indexer trace_max_threads = 256;
+    
+    /*! \brief How many elements of a traced loop each thread handles
+               between reads of the clock (see `Tracing::traced_functor`).
+    */
+    inline static constexpr indexer trace_clock_interval = 256;
+    
+    /*! \brief The size (in characters) above which the messages of each thread
+               are handed over to be output (see `Logging::log`).
+    */
+    inline static constexpr indexer log_buffer_size = 65536;
+    
+    /*! \brief The cell given to particles that have been removed from the system
+               (e. g. by absorbing boundary conditions) until they are taken out of the storage.
+    */
+    inline static constexpr indexer dead_particle_cell = std::numeric_limits<indexer>::min();
+    
+    /*! \brief The fraction of dead particles above which they are taken out of the storage.
+    */
+    inline static constexpr FLType dead_particle_threshold = 0.05;
+    
+    /*! \brief The factor by which the memory allocated for each particle species
+               is (at least) multiplied when it must grow.
+    */
+    inline static constexpr FLType particle_growth_factor = 1.5;
+    
+    /*! \brief The number of bins in each dimension of momentum space
+               in which the particles of a cell are grouped to be merged
+               (see `PopulationControl::band`).
+    */
+    inline static constexpr indexer population_momentum_bins = 4;
+    
+    /*! \brief The largest relative change in energy accepted when merging particles
+               in cases where it cannot be conserved exactly (see `PopulationControl::band`).
+    */
+    inline static constexpr FLType population_energy_tolerance = 1e-3;
+    
+    /*! \brief How far apart (in cell separations) the two halves of a split particle are placed.
+    */
+    inline static constexpr FLType population_split_displacement = 0.1;
+    
   }
 }
 
@@ -88,9 +183,96 @@ namespace Simbpolic
 
 namespace AFFPiCS
 {
-
   template <class parallelism, class particle>
-  using particle_holder = g24_lib::array_parallel<parallelism, particle>;
+  class particle_aos_holder;
+  //Defined in utilities/particle_reservoir.h
+  
+  template <class parallelism, class particle>
+  class particle_soa_holder;
+  //Defined in utilities/particle_soa.h
+  
+  template <class particle, class = void>
+  struct particle_is_soa : std::false_type {};
+  
+  template <class particle>
+  struct particle_is_soa<particle, std::void_t<decltype(particle::structure_of_arrays)>> :
+  std::bool_constant<particle::structure_of_arrays> {};
+  
+  template <class particle, class = void>
+  struct particle_is_weighted : std::false_type {};
+  
+  /*!
+    \brief Particles whose weight can change set `static constexpr bool weighted = true`
+            (see `Particles::particle_weighted`).
+  */
+  template <class particle>
+  struct particle_is_weighted<particle, std::void_t<decltype(particle::weighted)>> :
+  std::bool_constant<particle::weighted> {};
+  
+  /*!
+    \brief Particles are stored as an array of structures,
+           unless their type sets `static constexpr bool structure_of_arrays = true`.
+    
+    \remark In both cases, `size()` is the number of live particles,
+            which is all the kernels go through, while more memory may be allocated
+            (see `capacity()`) so that particles can be added without reallocating.
+  */
+  template <class parallelism, class particle>
+  using particle_holder = std::conditional_t< particle_is_soa<particle>::value,
+                                              particle_soa_holder<parallelism, particle>,
+                                              particle_aos_holder<parallelism, particle> >;
+  
+  template <class T, class = void>
+  struct particle_value_helper
+  {
+    using type = T;
+  };
+  
+  template <class T>
+  struct particle_value_helper<T, std::void_t<typename T::value_type>>
+  {
+    using type = typename T::value_type;
+  };
+  
+  /*!
+    \brief The type that holds an independent copy of a particle,
+           in case \p T is a proxy to a particle stored elsewhere.
+  */
+  template <class T>
+  using particle_value = typename particle_value_helper<std::decay_t<T>>::type;
+  
+  template <class stage, class = void>
+  struct stage_is_fusable : std::false_type {};
+  
+  /*!
+    \brief Pushers and depositers that can be fused with the other particle kernels
+           set `static constexpr bool fusable = true`.
+  */
+  template <class stage>
+  struct stage_is_fusable<stage, std::void_t<decltype(stage::fusable)>> :
+  std::bool_constant<stage::fusable> {};
+  
+  template <class pusher, class = void>
+  struct pusher_needs_fields : std::true_type {};
+  
+  /*!
+    \brief Pushers are assumed to read the fields,
+           unless they set `static constexpr bool needs_fields = false`.
+  */
+  template <class pusher>
+  struct pusher_needs_fields<pusher, std::void_t<decltype(pusher::needs_fields)>> :
+  std::bool_constant<pusher::needs_fields> {};
+  
+  template <class evolver, class = void>
+  struct evolver_is_staggerable : std::false_type {};
+  
+  /*!
+    \brief Evolvers that can leave the magnetic field half a timestep behind
+           set `static constexpr bool staggerable = true`.
+  */
+  template <class evolver>
+  struct evolver_is_staggerable<evolver, std::void_t<decltype(evolver::staggerable)>> :
+  std::bool_constant<evolver::staggerable> {};
   
   template <class T, indexer num_dims>
   using vector_type = g24_lib::fspoint<T, indexer, num_dims>;
@@ -126,16 +308,68 @@ namespace AFFPiCS
   
   template <indexer num_dims>
   using current_type = E_field_type<num_dims>;
+  
+  /*!
+    \brief Holds both fields as felt by a particle, as returned by a combined gather.
+  */
+  template <indexer num_dims>
+  struct EB_field_type
+  {
+    E_field_type<num_dims> E;
+    B_field_type<num_dims> B;
+  };
   //The currents will need to have the same dimensionality as the electric field.
   
+  template <class parallelism, indexer components>
+  class planar_field_holder;
+  //Defined in utilities/planar_fields.h
+  
+#ifdef AFFPICS_PLANAR_FIELDS
+  
+  /*!
+    \brief If `AFFPICS_PLANAR_FIELDS` is defined, the fields and currents are stored
+           with one array per component (see `planar_field_holder`),
+           otherwise as an array of vectors.
+  */
+  template <class parallelism, indexer components>
+  using field_storage = planar_field_holder<parallelism, components>;
+  
+#else
+  
+  template <class parallelism, indexer components>
+  using field_storage = g24_lib::array_parallel<parallelism, g24_lib::fspoint<FLType, indexer, components>>;
+  
+#endif
+  
+  template <class parallelism, class inner, indexer num_dims>
+  class ghost_field_holder;
+  //Defined in utilities/ghost_cells.h
+  
+#ifdef AFFPICS_GHOST_CELLS
+  
+  /*!
+    \brief If `AFFPICS_GHOST_CELLS` is defined, the fields and currents are surrounded
+           by a layer of `Defaults::ghost_cells` ghost cells (see `ghost_field_holder`),
+           so the neighbouring cells can be accessed without the boundary conditions.
+  */
+  template <class parallelism, indexer components, indexer num_dims>
+  using grid_storage = ghost_field_holder<parallelism, field_storage<parallelism, components>, num_dims>;
+  
+#else
+  
+  template <class parallelism, indexer components, indexer num_dims>
+  using grid_storage = field_storage<parallelism, components>;
+  
+#endif
+  
   template <class parallelism, indexer num_dims>
-  using E_field_holder = g24_lib::array_parallel<parallelism, E_field_type<num_dims>>;
+  using E_field_holder = grid_storage<parallelism, electric_field_dimensions<num_dims>(), num_dims>;
   
   template <class parallelism, indexer num_dims>
-  using B_field_holder = g24_lib::array_parallel<parallelism, B_field_type<num_dims>>;
+  using B_field_holder = grid_storage<parallelism, magnetic_field_dimensions<num_dims>(), num_dims>;
   
   template <class parallelism, indexer num_dims>
-  using current_holder = g24_lib::array_parallel<parallelism, current_type<num_dims>>;
+  using current_holder = grid_storage<parallelism, electric_field_dimensions<num_dims>(), num_dims>;
   
   
   struct Saver
@@ -149,12 +383,13 @@ namespace AFFPiCS
       bool save_on_interrupt;
     public:
   
-    virtual void save(const bool = Defaults::data_i_o_as_binary) const 
+    virtual void save(const bool = Defaults::data_i_o_as_binary)
+    //Not const, since saving may have to finish pending updates first.
     {
       return;
     }
     
-    virtual void save(const StrType&, const bool = Defaults::data_i_o_as_binary) const 
+    virtual void save(const StrType&, const bool = Defaults::data_i_o_as_binary)
     {
       return;
     }
@@ -278,6 +513,232 @@ namespace AFFPiCS
   
 }
 
+#ifndef AFFPICS_LOG_LEVEL
+  #ifdef DEBUG
+    #define AFFPICS_LOG_LEVEL 1
+  #else
+    #define AFFPICS_LOG_LEVEL 5
+  #endif
+#endif
+//The minimum level of the messages that are output
+//(see AFFPiCS::Logging::level; 5 means no messages at all).
+
+#ifndef AFFPICS_LOG_CATEGORIES
+  #define AFFPICS_LOG_CATEGORIES (~0u)
+#endif
+//A mask with the categories of messages that are output
+//(see AFFPiCS::Logging::category).
+
+#if AFFPICS_LOG_LEVEL < 5
+#include <sstream>
+#include <iostream>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#endif
+
+namespace AFFPiCS
+{
+  /*!
+    \brief Levelled, category-filtered messages.
+    
+    \remark The level and categories that are output are chosen at compile time
+            through `AFFPICS_LOG_LEVEL` and `AFFPICS_LOG_CATEGORIES`,
+            so the messages that are filtered out generate no code at all.
+            The others are written to a per-thread buffer, which is handed over
+            to a separate thread to be output once it is large enough,
+            so the threads that log do not have to wait for each other.
+  */
+  namespace Logging
+  {
+    enum level : int
+    {
+      trace = 0,
+      debug = 1,
+      info = 2,
+      warning = 3,
+      error = 4,
+      none = 5
+    };
+    
+    enum category : unsigned int
+    {
+      general = 1u,
+      gather = 1u << 1,
+      push = 1u << 2,
+      deposit = 1u << 3,
+      fields = 1u << 4,
+      io = 1u << 5,
+      all = ~0u
+    };
+    
+    template <level lvl, category cat>
+    inline constexpr bool enabled = (lvl >= AFFPICS_LOG_LEVEL) && (lvl < none) && ((cat & (AFFPICS_LOG_CATEGORIES)) != 0);
+    
+#if AFFPICS_LOG_LEVEL < 5
+    
+    namespace detail
+    {
+      class writer
+      //Outputs the messages handed over by the threads in a separate thread.
+      {
+        std::mutex mut;
+        std::condition_variable cond;
+        std::deque<std::string> queue;
+        bool stop;
+        std::thread thr;
+        
+        void run()
+        {
+          std::unique_lock<std::mutex> lock(mut);
+          while (true)
+            {
+              cond.wait(lock, [&]{ return stop || !queue.empty(); });
+              while (!queue.empty())
+                {
+                  std::string msg = std::move(queue.front());
+                  queue.pop_front();
+                  lock.unlock();
+#ifdef DEBUG
+                  global::log << msg;
+                  global::log.flush();
+#else
+                  std::clog << msg;
+                  std::clog.flush();
+#endif
+                  lock.lock();
+                }
+              if (stop)
+                {
+                  return;
+                }
+            }
+        }
+        
+        public:
+        
+        writer(): stop(false), thr([this]{ run(); })
+        {
+        }
+        
+        ~writer()
+        {
+          {
+            std::lock_guard<std::mutex> lock(mut);
+            stop = true;
+          }
+          cond.notify_one();
+          thr.join();
+        }
+        
+        void submit(std::string && msg)
+        {
+          {
+            std::lock_guard<std::mutex> lock(mut);
+            queue.push_back(std::move(msg));
+          }
+          cond.notify_one();
+        }
+      };
+      
+      inline writer& get_writer()
+      {
+        static writer w;
+        return w;
+      }
+      
+      struct thread_log
+      {
+        std::ostringstream buffer;
+        indexer count = 0;
+        //For the sampling.
+        
+        void flush()
+        {
+          std::string msg = buffer.str();
+          if (!msg.empty())
+            {
+              get_writer().submit(std::move(msg));
+              buffer.str("");
+            }
+        }
+        
+        ~thread_log()
+        {
+          flush();
+        }
+      };
+      
+      inline thread_log& local()
+      {
+        thread_local thread_log l;
+        return l;
+      }
+      
+      inline std::atomic<indexer> sampling{1};
+    }
+    
+    /*!
+      \brief Only one in every \p n messages (of each thread) will be output.
+    */
+    inline void set_sampling(const indexer n)
+    {
+      detail::sampling.store(std::max(indexer(1), n), std::memory_order_relaxed);
+    }
+    
+    /*!
+      \brief Hands over the messages of the calling thread to be output.
+    */
+    inline void flush()
+    {
+      detail::local().flush();
+    }
+    
+#else
+    
+    inline void set_sampling(const indexer)
+    {
+    }
+    
+    inline void flush()
+    {
+    }
+    
+#endif
+    
+    /*!
+      \brief Outputs a message with level \p lvl and category \p cat,
+             which is written by calling \p w with the stream.
+      
+      \remark Since the message is only written inside \p w,
+              nothing is evaluated when the message is filtered out.
+              To be used as `Logging::log<Logging::debug, Logging::gather>([&](auto &s){ s << ...; });`
+    */
+    template <level lvl, category cat, class Writer>
+    CUDA_HOS_DEV inline void log(Writer && w)
+    {
+#if AFFPICS_LOG_LEVEL < 5 && !defined(__CUDA_ARCH__)
+      if constexpr (enabled<lvl, cat>)
+        {
+          detail::thread_log &l = detail::local();
+          if (l.count++ % detail::sampling.load(std::memory_order_relaxed) == 0)
+            {
+              w(l.buffer);
+              l.buffer << '\n';
+              if (l.buffer.tellp() >= std::streamoff(Defaults::log_buffer_size))
+                {
+                  l.flush();
+                }
+            }
+        }
+#endif
+    }
+  }
+}
+
 #if AFFPICS_SKIP_INHERITANCE_CHECK
 #define AFFPICS_INHERITANCE_HACK_CHECK() sizeof(char) > 0
 #else
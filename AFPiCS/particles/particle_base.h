@@ -20,6 +20,9 @@ namespace AFFPiCS
     class particle_base
     {
       public:
+      
+      static constexpr indexer num_dimensions = num_dims;
+      
       /*!
           \brief The (relativistic) momentum over the rest mass
       */
@@ -78,6 +81,19 @@ namespace AFFPiCS
         return 0;
       }
       
+      /*!
+        \brief The number of physical particles represented by this one,
+               relative to the default.
+        
+        \remark Only particles that set `weighted` (see `Particles::particle_weighted`)
+                have weights other than 1.
+      */
+      template <class system_info>
+      CUDA_HOS_DEV FLType weight(const system_info &info) const
+      {
+        return FLType(1);
+      }
+      
       template <class system_info>
       CUDA_HOS_DEV FLType gamma(const system_info &info) const
       {
@@ -86,6 +102,19 @@ namespace AFFPiCS
         return sqrt(dhis->u(info).square_norm2()/info.units().c()/info.units().c()+FLType(1));
       }
       
+      /*!
+        \brief The inverse of the Lorentz factor of the particle.
+        
+        \remark Particles that keep this value around (such as `particle_cached_gamma`)
+                should override this so that `vel` needs no square root.
+      */
+      template <class system_info>
+      CUDA_HOS_DEV FLType inverse_gamma(const system_info &info) const
+      {
+        const derived* dhis = static_cast<const derived*>(this);
+        return FLType(1)/dhis->gamma(info);
+      }
+      
       /*!
         \brief The momentum of the particle, in appropriate units.
       */
@@ -103,7 +132,7 @@ namespace AFFPiCS
       CUDA_HOS_DEV vector_type<FLType, num_dims> vel(const system_info &info) const
       {
         const derived* dhis = static_cast<const derived*>(this);
-        return dhis->u(info).element_divide(info.cell_sizes())/dhis->gamma(info);
+        return dhis->u(info).element_divide(info.cell_sizes()) * dhis->inverse_gamma(info);
       }
       
       /*!
@@ -161,6 +190,29 @@ namespace AFFPiCS
         static_assert(AFFPICS_INHERITANCE_HACK_CHECK(), "Should define this somewhere else! Blame C++ for the lack of virtual templates...");
       }
       
+      /*!
+        \brief Marks the particle as removed from the system (e. g. by absorbing boundary conditions),
+               so that it is skipped by the kernels until it is taken out of the storage.
+        
+        \remark This is signalled by setting the cell to `Defaults::dead_particle_cell`,
+                so it needs no extra storage.
+        
+        \sa particle_storage_part::remove_dead
+      */
+      template <class system_info>
+      CUDA_HOS_DEV void kill(const system_info &info)
+      {
+        derived* dhis = static_cast<derived*>(this);
+        dhis->set_cell(vector_type<indexer, num_dims>(Defaults::dead_particle_cell), info);
+      }
+      
+      template <class system_info>
+      CUDA_HOS_DEV bool is_alive(const system_info &info) const
+      {
+        const derived* dhis = static_cast<const derived*>(this);
+        return dhis->cell(info)[0] != Defaults::dead_particle_cell;
+      }
+      
       /*!
         \brief Changes the position of the particle by \p how_much, measured in cell separations,
                and updates the cell at which the particle is situated accordingly.
@@ -0,0 +1,106 @@
+#ifndef AFFPICS_PARTICLES_PARTICLE_CACHED_GAMMA
+#define AFFPICS_PARTICLES_PARTICLE_CACHED_GAMMA
+
+/*!
+  \file particle_cached_gamma.h
+  
+  \brief A particle with fixed charge and rest mass that keeps the inverse of its Lorentz factor
+         alongside its momentum, so that the velocity can be obtained without a square root.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include "particle_simple.h"
+
+namespace AFFPiCS
+{
+  namespace Particles
+  {
+    /*!
+      \brief Behaves as `particle_simple`, but stores `1/gamma`, which is updated whenever the momentum is set.
+      
+      \remark The pushers always go through `set_u`, so, after the first step,
+              `vel`, `gamma` and `inverse_gamma` no longer need to compute any square roots.
+      
+      \remark The constructors and the input functions do not know the units of the system,
+              so they take 1/gamma to be 1 (as it is for the default momentum).
+              Particles created or read with any other momentum must have it set again with `set_u`,
+              which `Simulation` does for all of its particles (see `particle_storage::refresh`)
+              whenever they or the system information are changed.
+              Input and output are done in the same format as `particle_simple`.
+    */
+    template <indexer num_dims, class derived = void>
+    class particle_cached_gamma :
+    public particle_simple<num_dims, std::conditional_t<std::is_void_v<derived>, particle_cached_gamma<num_dims, derived>, derived>>
+    {
+      private:
+      
+      using deriv_t = std::conditional_t<std::is_void_v<derived>, particle_cached_gamma, derived>;
+      
+      using base_t = particle_simple<num_dims, deriv_t>;
+      
+      protected:
+      
+      FLType inv_gamma;
+      
+      template <class system_info>
+      CUDA_HOS_DEV FLType compute_inverse_gamma(const vector_type<FLType, num_dims> &mom, const system_info &info) const
+      {
+        using namespace std;
+        const FLType c = info.units().c();
+        return FLType(1)/sqrt(mom.square_norm2()/(c*c)+FLType(1));
+      }
+      
+      public:
+      
+      CUDA_HOS_DEV particle_cached_gamma(const vector_type<indexer, num_dims> &cll = vector_type<FLType, num_dims>(0),
+                                         const vector_type<FLType, num_dims> ps = vector_type<FLType, num_dims>(FLType(0.)),
+                                         const vector_type<FLType, num_dims> mm = vector_type<FLType, num_dims>(FLType(0.)) ):
+      base_t(cll, ps, mm), inv_gamma(1)
+      {
+      }
+      
+      template <class system_info>
+      CUDA_HOS_DEV FLType inverse_gamma(const system_info &info) const
+      {
+        return inv_gamma;
+      }
+      
+      template <class system_info>
+      CUDA_HOS_DEV FLType gamma(const system_info &info) const
+      {
+        return FLType(1)/inverse_gamma(info);
+      }
+      
+      template <class system_info>
+      CUDA_HOS_DEV vector_type<FLType, num_dims> vel(const system_info &info) const
+      {
+        return this->mom_over_mass.element_divide(info.cell_sizes()) * inverse_gamma(info);
+      }
+      
+      template <class system_info>
+      CUDA_HOS_DEV void set_u(const vector_type<FLType, num_dims>& new_u, const system_info &info)
+      {
+        this->mom_over_mass = new_u;
+        inv_gamma = compute_inverse_gamma(new_u, info);
+      }
+      
+      template<class stream>
+      CUDA_ONLY_HOS void textual_input(stream &s)
+      {
+        base_t::textual_input(s);
+        inv_gamma = 1;
+      }
+      
+      template<class stream>
+      CUDA_ONLY_HOS void binary_input(stream &s)
+      {
+        base_t::binary_input(s);
+        inv_gamma = 1;
+      }
+    };
+  }
+}
+
+#endif
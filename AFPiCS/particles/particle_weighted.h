@@ -0,0 +1,101 @@
+#ifndef AFFPICS_PARTICLES_PARTICLE_WEIGHTED
+#define AFFPICS_PARTICLES_PARTICLE_WEIGHTED
+
+/*!
+  \file particle_weighted.h
+  
+  \brief A particle with fixed charge and rest mass that represents
+         a variable number of physical particles.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include "particle_simple.h"
+
+namespace AFFPiCS
+{
+  namespace Particles
+  {
+    /*!
+      \brief Behaves as `particle_simple`, but carries a weight, which multiplies
+             the current it deposits, so that density profiles can be represented
+             with a uniform number of particles per cell (see `Sources::ProfileLoader`)
+             and particles can be merged or split (see `PopulationControl`).
+      
+      \remark The weight is output after the momentum.
+      
+      \remark Since the structure of arrays layout only holds cells, positions and momenta,
+              these particles must be stored as an array of structures.
+    */
+    template <indexer num_dims, class derived = void>
+    class particle_weighted :
+    public particle_simple<num_dims, std::conditional_t<std::is_void_v<derived>, particle_weighted<num_dims, derived>, derived>>
+    {
+      private:
+      
+      using deriv_t = std::conditional_t<std::is_void_v<derived>, particle_weighted, derived>;
+      
+      using base_t = particle_simple<num_dims, deriv_t>;
+      
+      protected:
+      
+      FLType w;
+      
+      public:
+      
+      static constexpr bool weighted = true;
+      
+      CUDA_HOS_DEV particle_weighted(const vector_type<indexer, num_dims> &cll = vector_type<FLType, num_dims>(0),
+                                     const vector_type<FLType, num_dims> ps = vector_type<FLType, num_dims>(FLType(0.)),
+                                     const vector_type<FLType, num_dims> mm = vector_type<FLType, num_dims>(FLType(0.)),
+                                     const FLType wt = FLType(1) ):
+      base_t(cll, ps, mm), w(wt)
+      {
+      }
+      
+      template <class system_info>
+      CUDA_HOS_DEV FLType weight(const system_info &info) const
+      {
+        return w;
+      }
+      
+      template <class system_info>
+      CUDA_HOS_DEV void set_weight(const FLType new_w, const system_info &info)
+      {
+        w = new_w;
+      }
+      
+      template<class stream, class str = std::basic_string<typename stream::char_type>>
+      CUDA_ONLY_HOS void textual_output(stream &s, const str& separator = " ") const
+      {
+        base_t::textual_output(s, separator);
+        s << separator;
+        g24_lib::textual_output(s, w);
+      }
+      
+      template<class stream>
+      CUDA_ONLY_HOS void binary_output(stream &s) const
+      {
+        base_t::binary_output(s);
+        g24_lib::binary_output(s, w);
+      }
+      
+      template<class stream>
+      CUDA_ONLY_HOS void textual_input(stream &s)
+      {
+        base_t::textual_input(s);
+        g24_lib::textual_input(s, w);
+      }
+      
+      template<class stream>
+      CUDA_ONLY_HOS void binary_input(stream &s)
+      {
+        base_t::binary_input(s);
+        g24_lib::binary_input(s, w);
+      }
+    };
+  }
+}
+
+#endif
@@ -20,48 +20,52 @@ namespace AFFPiCS
   {
     struct HigueraCary
     {
-      template<class part_arr, class E_arr, class B_arr, class S_Info>
-      CUDA_HOS_DEV void operator() ( part_arr& parts,
-                                     const indexer i,
-                                     const E_arr & E_fields,
-                                     const B_arr & B_fields,
-                                     const FLType dt,
-                                     const S_Info & info       ) const
+      template<class part, class E_type, class B_type, class S_Info>
+      CUDA_HOS_DEV void push ( part&& particle,
+                               const E_type & E,
+                               const B_type & B,
+                               const FLType dt,
+                               const S_Info & info ) const
+      //E and B are the fields already gathered at the particle.
       {
-        auto&& particle = parts[i];
-        
         const FLType q_dt_m_factor = particle.charge(info) * dt/2/particle.mass(info);
         //(q dt)/(2 m)
         
         //particle.move(particle.u(info).element_divide(info.cell_sizes())/particle.gamma(info) * dt/2);
         //Half update with the previous velocity;
         
+        particle.set_u(updated_u(particle.u(info), E, B, q_dt_m_factor, info.units().c()), info);
         
-        const auto u_minus = particle.u(info) + info.E_gather(E_fields, particle)
-                                  * q_dt_m_factor;
-        
-        
-        const auto tau = info.B_gather(B_fields, particle) * q_dt_m_factor;
-        
-        const FLType u_star = AFFPiCS::dot_product(u_minus, tau)/info.units().c();
+        //particle.move(particle.u(info).element_divide(info.cell_sizes())/particle.gamma(info) * dt/2, info);
+        //Half update with the next velocity;
+      }
+      
+      /*!
+        \brief The momentum over mass after the push, given the one before (\p u),
+               the fields felt by the particle and \p q_dt_m_factor = (q dt)/(2 m).
         
+        \remark Only uses vector arithmetic, so it works both for a single particle
+                and for a batch of them (given as `SIMD::vec`).
+      */
+      template <class U, class E_type, class B_type, class S>
+      CUDA_HOS_DEV static U updated_u(const U &u, const E_type &E, const B_type &B, const S &q_dt_m_factor, const FLType c)
+      {
         using namespace std;
         
+        const auto u_minus = u + E * q_dt_m_factor;
         
-        const FLType sigma = FLType(1) + u_minus.square_norm2()/info.units().c()/info.units().c() - tau.square_norm2();
+        const auto tau = B * q_dt_m_factor;
         
-        const auto t_vec = tau/sqrt( (sigma + sqrt(sigma * sigma+4*(tau.square_norm2()+u_star * u_star)))/2 );
+        const auto u_star = AFFPiCS::dot_product(u_minus, tau)/c;
         
-        const auto u_plus = (u_minus + t_vec * AFFPiCS::dot_product(u_minus, t_vec) +
-                              AFFPiCS::cross_product(u_minus, t_vec)                  )/(1 + t_vec.square_norm2());
+        const auto sigma = FLType(1) + u_minus.square_norm2()/c/c - tau.square_norm2();
         
-        particle.set_u(u_plus + q_dt_m_factor * info.E_gather(E_fields, particle) +
-                        AFFPiCS::cross_product(u_minus, t_vec), info                                            );
+        const auto t_vec = tau/sqrt( (sigma + sqrt(sigma * sigma + FLType(4)*(tau.square_norm2() + u_star * u_star)))/FLType(2) );
         
-        //particle.move(particle.u(info).element_divide(info.cell_sizes())/particle.gamma(info) * dt/2, info);
-        //Half update with the next velocity;
+        const auto u_plus = (u_minus + t_vec * AFFPiCS::dot_product(u_minus, t_vec) +
+                             AFFPiCS::cross_product(u_minus, t_vec)                  )/(FLType(1) + t_vec.square_norm2());
         
-        parts[i] = particle;
+        return u_plus + E * q_dt_m_factor + AFFPiCS::cross_product(u_minus, t_vec);
       }
     };
   }
@@ -70,6 +74,9 @@ namespace AFFPiCS
   {
     template <class system_info, indexer num_dims, template <indexer> class ... particles>
     using HigueraCary = SimplePusher<PusherFunctors::HigueraCary, system_info, num_dims, particles...>;
+    
+    template <class system_info, indexer num_dims, template <indexer> class ... particles>
+    using HigueraCaryBatched = SimplePusher<PusherFunctors::Batched<PusherFunctors::HigueraCary>, system_info, num_dims, particles...>;
   }
 }
 
@@ -12,6 +12,7 @@
 
 #include "../header.h"
 #include "../utilities/helpers.h"
+#include "../utilities/planar_fields.h"
 #include "../utilities/particle_storage.h"
 
 namespace AFFPiCS
@@ -45,6 +46,10 @@ namespace AFFPiCS
         }
       };
      
+      static constexpr bool fusable = false;
+      
+      static constexpr bool needs_fields = false;
+      
       struct results {};
       //There's no need to return anything from here.
       //Might be useful for debugging, but later...
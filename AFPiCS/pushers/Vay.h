@@ -20,50 +20,54 @@ namespace AFFPiCS
   {
     struct Vay
     {
-      template<class part_arr, class E_arr, class B_arr, class S_Info>
-      CUDA_HOS_DEV void operator() ( part_arr& parts,
-                                     const indexer i,
-                                     const E_arr & E_fields,
-                                     const B_arr & B_fields,
-                                     const FLType dt,
-                                     const S_Info & info       ) const
+      template<class part, class E_type, class B_type, class S_Info>
+      CUDA_HOS_DEV void push ( part&& particle,
+                               const E_type & E,
+                               const B_type & B,
+                               const FLType dt,
+                               const S_Info & info ) const
+      //E and B are the fields already gathered at the particle.
       {
-        auto&& particle = parts[i];
+        const FLType q_dt_m_factor = particle.charge(info) * dt/2/particle.mass(info);
+        //(q dt)/(2 m)
         
         //particle.move(particle.u(info).element_divide(info.cell_sizes())/particle.gamma(info) * dt/2);
         //Half update with the previous velocity;
         
-        const FLType q_dt_m_factor = particle.charge(info) * dt/2/particle.mass(info);
-        //(q dt)/(2 m)
+        particle.set_u(updated_u(particle.u(info), E, B, q_dt_m_factor, info.units().c()), info);
         
-        const auto u_half = particle.u(info) +
-                            (info.E_gather(E_fields, particle) +
-                             AFFPiCS::cross_product(particle.u(info)/particle.gamma(info),
-                                                       info.B_gather(B_fields, particle)
-                                                      )
-                            ) * q_dt_m_factor;
+        //particle.move(particle.u(info).element_divide(info.cell_sizes())/particle.gamma(info) * dt/2, info);
+        //Half update with the next velocity;
+      }
+      
+      /*!
+        \brief The momentum over mass after the push, given the one before (\p u),
+               the fields felt by the particle and \p q_dt_m_factor = (q dt)/(2 m).
         
-        const auto u_prime = u_half + info.E_gather(E_fields, particle) * q_dt_m_factor;
+        \remark Only uses vector arithmetic, so it works both for a single particle
+                and for a batch of them (given as `SIMD::vec`).
+      */
+      template <class U, class E_type, class B_type, class S>
+      CUDA_HOS_DEV static U updated_u(const U &u, const E_type &E, const B_type &B, const S &q_dt_m_factor, const FLType c)
+      {
+        using namespace std;
         
-        const auto tau = info.B_gather(B_fields, particle) * q_dt_m_factor;
+        const auto gamma = sqrt(FLType(1) + u.square_norm2()/c/c);
         
-        const FLType u_star = AFFPiCS::dot_product(u_prime, tau)/info.units().c();
+        const auto u_half = u + (E + AFFPiCS::cross_product(u/gamma, B)) * q_dt_m_factor;
         
-        using namespace std;
-                
-        const FLType sigma = FLType(1) + u_prime.square_norm2()/info.units().c()/info.units().c() - tau.square_norm2();
-                
+        const auto u_prime = u_half + E * q_dt_m_factor;
         
-        const auto t_vec = tau/sqrt( (sigma + sqrt(sigma * sigma+4*(tau.square_norm2()+u_star * u_star)))/2 );
+        const auto tau = B * q_dt_m_factor;
         
-        particle.set_u((u_prime + t_vec * AFFPiCS::dot_product(u_prime, t_vec) + 
-                        AFFPiCS::cross_product(u_prime, t_vec)                   )/
-                            (FLType(1)+t_vec.square_norm2()), info                         );
-                
-        //particle.move(particle.u(info).element_divide(info.cell_sizes())/particle.gamma(info) * dt/2, info);
-        //Half update with the next velocity;
+        const auto u_star = AFFPiCS::dot_product(u_prime, tau)/c;
         
-        parts[i] = particle;
+        const auto sigma = FLType(1) + u_prime.square_norm2()/c/c - tau.square_norm2();
+        
+        const auto t_vec = tau/sqrt( (sigma + sqrt(sigma * sigma + FLType(4)*(tau.square_norm2() + u_star * u_star)))/FLType(2) );
+        
+        return (u_prime + t_vec * AFFPiCS::dot_product(u_prime, t_vec) +
+                AFFPiCS::cross_product(u_prime, t_vec)                   )/(FLType(1) + t_vec.square_norm2());
       }
     };
   }
@@ -72,6 +76,9 @@ namespace AFFPiCS
   {
     template <class system_info, indexer num_dims, template <indexer> class ... particles>
     using Vay = SimplePusher<PusherFunctors::Vay, system_info, num_dims, particles...>;
+    
+    template <class system_info, indexer num_dims, template <indexer> class ... particles>
+    using VayBatched = SimplePusher<PusherFunctors::Batched<PusherFunctors::Vay>, system_info, num_dims, particles...>;
   }
 }
 
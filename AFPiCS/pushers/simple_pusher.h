@@ -13,11 +13,49 @@
 #include "../header.h"
 #include "../utilities/helpers.h"
 #include "../utilities/particle_storage.h"
+#include "../utilities/planar_fields.h"
+#include "../utilities/ghost_cells.h"
+#include "../system_info/system_info_maker.h"
+#include "../utilities/simd.h"
+#include "../utilities/tracing.h"
 
 namespace AFFPiCS
 {
+  namespace PusherFunctors
+  {
+    /*!
+      \brief Marks that the particles pushed with \p pusher_functor
+             should be processed in batches of `SIMD::native_width<FLType>`
+             whenever they are stored as a structure of arrays.
+      
+      \pre \p pusher_functor must provide a static `updated_u(u, E, B, q_dt_m_factor, c)`
+           that only uses vector arithmetic, so it can be applied to `SIMD::vec`.
+    */
+    template <class pusher_functor>
+    struct Batched : public pusher_functor
+    {
+      static constexpr bool batched = true;
+    };
+  }
+  
+  template <class pusher_functor, class = void>
+  struct pusher_is_batched : std::false_type {};
+  
+  template <class pusher_functor>
+  struct pusher_is_batched<pusher_functor, std::void_t<decltype(pusher_functor::batched)>> :
+  std::bool_constant<pusher_functor::batched> {};
+  
   namespace Pushers
   {
+    /*!
+      \brief Pushes the particles with \p pusher_functor, whose
+              `push(particle, E, B, dt, info)` receives the fields
+              already gathered at the particle.
+      
+      \remark The fields are gathered exactly once per particle
+              and shared by all the stages of the push,
+              in a single pass through `EB_gather` if the system supports it.
+    */
     template <class pusher_functor, class system_info, indexer num_dims, template <indexer> class ... particles>
     class SimplePusher
     {    
@@ -25,27 +63,142 @@ namespace AFFPiCS
       template <class parallelism>
       using particle_storage_type = particle_storage<parallelism, particles<num_dims>...>;
       
+      template<class part_type, class E_arr, class B_arr, class S_Info>
+      CUDA_HOS_DEV static EB_field_type<num_dims> gather( const part_type& particle,
+                                                          const E_arr & E_fields,
+                                                          const B_arr & B_fields,
+                                                          const S_Info & info       )
+      {
+        if constexpr (SystemDefinitions::combined_gather_v<S_Info, E_arr, B_arr, part_type>)
+          {
+            return info.EB_gather(E_fields, B_fields, particle);
+          }
+        else
+          {
+            return EB_field_type<num_dims>{info.E_gather(E_fields, particle), info.B_gather(B_fields, particle)};
+          }
+      }
+      
+      struct gather_and_push_functor
+      {
+        template<class part_arr, class E_arr, class B_arr, class S_Info>
+        CUDA_HOS_DEV void operator() ( part_arr& parts,
+                                       const indexer i,
+                                       const E_arr & E_fields,
+                                       const B_arr & B_fields,
+                                       const FLType dt,
+                                       const S_Info & info       ) const
+        {
+          auto&& particle = parts[i];
+          
+          if (!particle.is_alive(info))
+            {
+              return;
+            }
+          
+          const EB_field_type<num_dims> fields = gather(particle, E_fields, B_fields, info);
+          
+          pusher_functor{}.push(particle, fields.E, fields.B, dt, info);
+          
+          parts[i] = particle;
+        }
+      };
+      
+      static constexpr indexer batch_size = SIMD::native_width<FLType>;
+      
+      struct batch_functor
+      //Pushes the batch_size particles starting at b * batch_size,
+      //with the last (incomplete) batch being pushed one particle at a time.
+      {
+        template<class BatchArr, class part_arr, class E_arr, class B_arr, class S_Info>
+        CUDA_HOS_DEV void operator() ( const BatchArr & batches,
+                                       const indexer b,
+                                       part_arr& parts,
+                                       const E_arr & E_fields,
+                                       const B_arr & B_fields,
+                                       const FLType dt,
+                                       const S_Info & info       ) const
+        {
+          const indexer first = b * batch_size;
+          
+          if (first + batch_size > parts.size())
+            {
+              for (indexer i = first; i < parts.size(); ++i)
+                {
+                  gather_and_push_functor{}(parts, i, E_fields, B_fields, dt, info);
+                }
+              return;
+            }
+          
+          SIMD::vec<num_dims, batch_size> u;
+          SIMD::vec<electric_field_dimensions<num_dims>(), batch_size> E;
+          SIMD::vec<magnetic_field_dimensions<num_dims>(), batch_size> B;
+          
+          for (indexer l = 0; l < batch_size; ++l)
+            {
+              const auto particle = parts[first + l];
+              const EB_field_type<num_dims> fields = ( particle.is_alive(info) ?
+                                                       gather(particle, E_fields, B_fields, info) :
+                                                       EB_field_type<num_dims>{E_field_type<num_dims>(0), B_field_type<num_dims>(0)} );
+              //Without any fields, the dead particles are left unchanged.
+              E.set_lane(l, fields.E);
+              B.set_lane(l, fields.B);
+            }
+          
+          for (indexer d = 0; d < num_dims; ++d)
+            {
+              for (indexer l = 0; l < batch_size; ++l)
+                {
+                  u[d].set_lane(l, parts.u_component(d)[first + l]);
+                }
+            }
+          
+          const FLType q_dt_m_factor = parts[first].charge(info) * dt/2/parts[first].mass(info);
+          //All the particles stored as a structure of arrays have the same charge and mass.
+          
+          const SIMD::vec<num_dims, batch_size> new_u = pusher_functor::updated_u(u, E, B, q_dt_m_factor, info.units().c());
+          
+          for (indexer d = 0; d < num_dims; ++d)
+            {
+              for (indexer l = 0; l < batch_size; ++l)
+                {
+                  parts.u_component(d)[first + l] = new_u[d].lane(l);
+                }
+            }
+        }
+      };
+      
+      template <class part>
+      static constexpr bool use_batches = pusher_is_batched<pusher_functor>::value && particle_is_soa<part>::value;
+      
       public:
       
       template <class parallelism> struct storage
       {
         typename parallelism::kernel_size_type kernel[sizeof...(particles)];
         
+        g24_lib::array_parallel<parallelism, indexer> batches[sizeof...(particles)];
+        //Only used for batched pushers, to go over the batches of each species.
+        
         private:
         
-        template <indexer idx, class part, class ... parts> void initialize_in(const particle_storage_type<parallelism> &part_store)
+        template <indexer idx, class part, class ... parts> void initialize_in(const particle_storage_type<parallelism> &part_store, const system_info& info)
         {
-          initialize_single<idx, part>(part_store);
+          initialize_single<idx, part>(part_store, info);
           if constexpr (sizeof...(parts) > 0)
             {
-              initialize_in<idx + 1, parts...>(part_store);
+              initialize_in<idx + 1, parts...>(part_store, info);
             }
         }
         
-        template <indexer idx, class part> void initialize_single(const particle_storage_type<parallelism> &part_store)
+        template <indexer idx, class part> void initialize_single(const particle_storage_type<parallelism> &part_store, const system_info& info)
         {
+          check_ghost_reach<E_field_holder<parallelism, num_dims>>(info.template particle_cell_radius<part>(part{}) + 1);
+          check_ghost_reach<B_field_holder<parallelism, num_dims>>(info.template particle_cell_radius<part>(part{}) + 1);
+          //The gathers reach one cell beyond the shape radius.
+          
           kernel[idx] = parallelism::template estimate_loop_kernel_size
-                                      < particle_holder<parallelism, part>, pusher_functor,
+                                      < particle_holder<parallelism, part>, Tracing::traced_t<gather_and_push_functor>,
                                         E_field_holder<parallelism, num_dims>,
                                         B_field_holder<parallelism, num_dims>,
                                         FLType, system_info                     >
@@ -59,7 +212,7 @@ namespace AFFPiCS
                          const B_field_holder<parallelism, num_dims> &B_fields,
                          const system_info& info                                )
         {
-          initialize_in<0, particles<num_dims>...>(part_store);
+          initialize_in<0, particles<num_dims>...>(part_store, info);
         }
         
         template <class stream> void save(stream &s, bool binary = Defaults::data_i_o_as_binary) const
@@ -96,12 +249,46 @@ namespace AFFPiCS
                                    const FLType dt,
                                    const system_info& info)
       {
-        parallelism::loop(store.kernel[idx], part_storage.template get_particles<part>(),
-                          pusher_functor{}, E_fields, B_fields, dt, info);
+        auto &parts = part_storage.template get_particles<part>();
+        
+        if constexpr (use_batches<part>)
+          {
+            const indexer num_batches = (parts.size() + batch_size - 1) / batch_size;
+            
+            if (store.batches[idx].size() != num_batches)
+              {
+                store.batches[idx].resize(num_batches);
+              }
+            
+            parallelism::loop(store.batches[idx], Tracing::trace("push (batched)", batch_functor{}), parts, E_fields, B_fields, dt, info);
+          }
+        else
+          {
+            parallelism::loop(store.kernel[idx], parts, Tracing::trace("push", gather_and_push_functor{}), E_fields, B_fields, dt, info);
+          }
       }
       
       public:
       
+      /*!
+        \brief The functor that pushes a single particle,
+               so that other kernels can push particles
+               as one of the steps they perform on each of them.
+      */
+      using particle_functor = gather_and_push_functor;
+      
+      /*!
+        \brief Signals that the pusher can be fused with other particle kernels
+                through `particle_functor`.
+      */
+      static constexpr bool fusable = true;
+      
+      /*!
+        \brief Signals that the pusher reads the fields,
+               so the magnetic field is never left behind (see `Simulation::set_staggered_fields`).
+      */
+      static constexpr bool needs_fields = true;
+      
       struct results {};
       //There's no need to return anything from here.
       //Might be useful for debugging, but later...
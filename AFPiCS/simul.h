@@ -11,8 +11,14 @@
 
 #include "header.h"
 #include "utilities/particle_storage.h"
+#include "utilities/population_control.h"
+#include "utilities/planar_fields.h"
+#include "utilities/ghost_cells.h"
 #include "utilities/diagnostic_handler.h"
+#include "utilities/timing.h"
+#include "utilities/tracing.h"
 #include <fstream>
+#include <array>
 
 namespace AFFPiCS
 {
@@ -35,6 +41,12 @@ namespace AFFPiCS
     
     current_holder<parallelism, num_dims> currents;
     
+    current_holder<parallelism, num_dims> next_currents;
+    //When the particle stages are fused, the currents for the next step
+    //are deposited before the fields are evolved with the current ones,
+    //so we need somewhere else to put them.
+    //(It's only resized when needed.)
+    
     template <class system_info>
     void initialize(const system_info &info)
     {
@@ -43,6 +55,14 @@ namespace AFFPiCS
       depositer.initialize(particles, currents, info);
     }
     
+    template <class system_info>
+    void fill_ghosts(const system_info &info)
+    //Does nothing unless the fields are stored with ghost cells.
+    {
+      update_E_ghosts(E_fields, info);
+      update_B_ghosts(B_fields, info);
+    }
+    
     template <class stream> void save(stream &s, bool binary = Defaults::data_i_o_as_binary) const
     {
       pusher.save(s, binary);
@@ -105,6 +125,22 @@ namespace AFFPiCS
       storage store;
       system_info info;
       bool initialized;
+      bool fused_step;
+      bool merged_moves;
+      FLType pending_move;
+      //How long the particles must still be moved for
+      //to be synchronized with the fields.
+      indexer sort_interval, steps_since_sort;
+      bool incremental_sort;
+      bool remove_particles;
+      FLType removal_threshold;
+      PopulationControl::band population;
+      PopulationControl::controller<parallelism> population_controller;
+      indexer population_interval, steps_since_population;
+      indexer step_number;
+      //The number of steps since the initial conditions,
+      //which also identifies the random streams of the particle sources.
+      Timing::step_timings total_timings;
       
     public:
       
@@ -118,35 +154,72 @@ namespace AFFPiCS
         return store;
       }
       
+      /*!
+        \brief The time spent in each stage and the work done, summed over all the steps
+                since the simulation was created (or `reset_timings` was called).
+        
+        \remark The times are only measured if `AFFPICS_TIMING` is defined.
+      */
+      const Timing::step_timings& get_timings() const
+      {
+        return total_timings;
+      }
+      
+      void reset_timings()
+      {
+        total_timings = Timing::step_timings{};
+      }
+      
+      /*!
+        \brief The number of steps simulated since the initial conditions were set.
+      */
+      indexer get_step() const
+      {
+        return step_number;
+      }
+      
       static StrType default_name()
       {
         return StrType("PIC_simul");
       }
       
       Simulation(const system_info &s_info, const StrType& new_name = default_name()):
-      info(s_info), initialized(false)
+      info(s_info), initialized(false), fused_step(false), merged_moves(false), pending_move(0),
+      sort_interval(0), steps_since_sort(0), incremental_sort(true),
+      remove_particles(false), removal_threshold(Defaults::dead_particle_threshold),
+      population_interval(0), steps_since_population(0), step_number(0)
       {
         this->set_name(new_name);
         this->set_save_on_all(true);
       }
       
-      void save(const StrType& save_name, const bool binary = Defaults::data_i_o_as_binary) const
+      void save(const StrType& save_name, const bool binary = Defaults::data_i_o_as_binary)
       {
+        if (!is_synchronized())
+          {
+            synchronize();
+            //Checkpoints must have the particles and the magnetic field at the same time as the electric field.
+            //This only finishes the updates that were already pending,
+            //so it does not change the outcome of the simulation.
+          }
         std::ofstream file(save_name + Defaults::file_extension);
         store.save(file, binary);
         if (binary)
           {
             g24_lib::binary_output(file, initialized);
+            g24_lib::binary_output(file, step_number);
           }
         else
           {
             file << " ";
             g24_lib::textual_output(file, initialized);
+            file << " ";
+            g24_lib::textual_output(file, step_number);
           }
         file.close();
       }
       
-      void save(const bool binary = Defaults::data_i_o_as_binary) const
+      void save(const bool binary = Defaults::data_i_o_as_binary)
       {
         save(this->get_name(), binary);
       }
@@ -158,12 +231,16 @@ namespace AFFPiCS
         if (binary)
           {
             g24_lib::binary_input(file, initialized);
+            g24_lib::binary_input(file, step_number);
           }
         else
           {
             g24_lib::textual_input(file, initialized);
+            g24_lib::textual_input(file, step_number);
           }
         file.close();
+        store.particles.refresh(info);
+        pending_move = 0;
         initialize(false);
       }
       
@@ -184,16 +261,23 @@ namespace AFFPiCS
       void set_particles(const particle_storage<parallelism, particles<num_dims>...> & new_particles)
       {
         store.particles = new_particles;
+        store.particles.refresh(info);
+        //In case the particles were created without knowing the units of the system.
+        pending_move = 0;
+        kernel_size_estimation<0, particles<num_dims>...>();
       }
       
       void set_E(const E_field_holder<parallelism, num_dims> & new_fields)
       {
+        synchronize_fields();
+        //The pending update of the magnetic field uses the old electric field.
         store.E_fields = new_fields;
       }
       
       void set_B(const B_field_holder<parallelism, num_dims> & new_fields)
       {
         store.B_fields = new_fields;
+        discard_pending_B();
       }
       
       void set_fields( const E_field_holder<parallelism, num_dims> & new_E,
@@ -201,6 +285,7 @@ namespace AFFPiCS
       {
         store.E_fields = new_E;
         store.B_fields = new_B;
+        discard_pending_B();
       }
       
       void set_currents(const current_holder<parallelism, num_dims> & new_currents)
@@ -211,18 +296,282 @@ namespace AFFPiCS
       void set_info(const system_info &new_info)
       {
         info = new_info;
+        store.particles.refresh(info);
+        //Anything the particles keep that depends on the units must match the new ones.
+      }
+      
+      /*!
+        \brief If \p fuse is `true`, each species is moved, pushed, deposited and moved again
+               in a single pass through its particles, instead of one pass for each stage.
+        
+        \remark This only takes effect if both the pusher and the depositer support it
+                and if the diagnostics only check `pre_step` and/or `post_step`,
+                since there is no moment where the other diagnostics could be called.
+                Otherwise, the stages are performed separately as usual.
+      */
+      void set_fused_step(const bool fuse)
+      {
+        fused_step = fuse;
+      }
+      
+      bool get_fused_step() const
+      {
+        return fused_step;
+      }
+      
+      /*!
+        \brief If \p merge is `true`, the particles are not moved by the last half timestep
+               at the end of each step: that is merged with the first half timestep move of the next one,
+               saving one pass through the particles per step.
+        
+        \remark The particles are still moved by the full timestep
+                whenever the diagnostics need them to be synchronized with the fields,
+                that is, on the steps where they have `pre_step` or `post_step`
+                (for which, if the diagnostics have a member function `bool synchronized_step(const FLType dt, const system_info &info)`,
+                only if it returns `true`), and before saving.
+                If the diagnostics have `before_mover`, `after_mover` or `inject`, the moves are never merged.
+        
+        \remark If the state of the particles is needed outside of `simulate_once` (through `get_storage`),
+                call `synchronize` first.
+        
+        \sa synchronize
+      */
+      void set_merged_moves(const bool merge)
+      {
+        merged_moves = merge;
+        if (!merge)
+          {
+            synchronize_particles();
+          }
+      }
+      
+      bool get_merged_moves() const
+      {
+        return merged_moves;
+      }
+      
+      /*!
+        \brief If \p stagger is `true`, the field evolver (if it supports it, see `Evolvers::FDTD::staggerable`)
+               leaves the magnetic field half a timestep behind at the end of each step,
+               merging the last half timestep update with the first one of the next step,
+               which saves one of the three passes through the fields.
+        
+        \remark This does not apply to pushers that gather the fields (see `pusher_needs_fields`),
+                which is the case of every `Pushers::SimplePusher`:
+                they would need the synchronized magnetic field at every step,
+                so there would be nothing to save and the fields are always kept synchronized.
+        
+        \remark Otherwise, the magnetic field is synchronized on the steps where the diagnostics need it
+                (under the same conditions as in `set_merged_moves`,
+                with any other diagnostic after the pusher preventing the staggering altogether)
+                and before saving.
+        
+        \remark If the fields are needed outside of `simulate_once` (through `get_storage`),
+                call `synchronize` first.
+        
+        \sa synchronize
+      */
+      void set_staggered_fields(const bool stagger)
+      {
+        if constexpr (evolver_is_staggerable<field_evolver>::value)
+          {
+            store.evolver.staggered = stagger;
+            if (!stagger)
+              {
+                synchronize_fields();
+              }
+          }
+      }
+      
+      bool get_staggered_fields() const
+      {
+        if constexpr (evolver_is_staggerable<field_evolver>::value)
+          {
+            return store.evolver.staggered;
+          }
+        else
+          {
+            return false;
+          }
+      }
+      
+      /*!
+        \brief Finishes moving the particles and evolving the magnetic field
+               so that they correspond to the same time as the electric field.
+        
+        \sa set_merged_moves, set_staggered_fields
+      */
+      void synchronize()
+      {
+        synchronize_particles();
+        synchronize_fields();
+      }
+      
+      bool is_synchronized() const
+      {
+        if constexpr (evolver_is_staggerable<field_evolver>::value)
+          {
+            return pending_move == 0 && store.evolver.pending_B == 0;
+          }
+        else
+          {
+            return pending_move == 0;
+          }
+      }
+      
+      /*!
+        \brief Sorts the particles according to their cells
+               at the start of every \p interval steps,
+               so that the memory accesses to the fields and currents
+               stay (mostly) local as the particles move.
+        
+        \param interval The number of steps between sorts. If it is 0, the particles are never sorted.
+        
+        \param incremental If `true`, only the particles that have changed cells since the last sort
+                           are relocated, as long as they are few enough.
+        
+        \sa particle_storage_part::sort_by_cell
+      */
+      void set_sort_interval(const indexer interval, const bool incremental = true)
+      {
+        sort_interval = interval;
+        incremental_sort = incremental;
+        steps_since_sort = interval;
+        //So that the particles are sorted right at the next step.
+      }
+      
+      indexer get_sort_interval() const
+      {
+        return sort_interval;
+      }
+      
+      void set_incremental_sort(const bool incremental)
+      {
+        incremental_sort = incremental;
+      }
+      
+      bool get_incremental_sort() const
+      {
+        return incremental_sort;
+      }
+      
+      /*!
+        \brief If \p remove is `true`, the dead particles (see `particle_base::kill`)
+               are taken out of the storage at the start of each step
+               in which they are more than a fraction \p threshold of the particles of their species.
+        
+        \remark Until they are removed, the dead particles are skipped by the mover, pusher and depositer,
+                 so this only matters for the memory and the time spent going through them.
+        
+        \sa particle_storage_part::remove_dead
+      */
+      void set_particle_removal(const bool remove, const FLType threshold = Defaults::dead_particle_threshold)
+      {
+        remove_particles = remove;
+        removal_threshold = threshold;
+      }
+      
+      bool get_particle_removal() const
+      {
+        return remove_particles;
+      }
+      
+      /*!
+        \brief Every \p interval steps, merges and splits the weighted particles
+               (see `Particles::particle_weighted`) so that the number of particles
+               in each cell stays within the band \p b.
+        
+        \param interval The number of steps between applications. If it is 0, this is disabled.
+        
+        \remark The species whose particles have no weights are left unchanged.
+        
+        \sa PopulationControl::controller
+      */
+      void set_population_control(const PopulationControl::band &b, const indexer interval)
+      {
+        population = b;
+        population_interval = interval;
+        steps_since_population = interval;
+        //So that it is applied right at the next step.
+      }
+      
+      indexer get_population_interval() const
+      {
+        return population_interval;
+      }
+      
+      /*!
+        \brief Removes the dead particles right away, regardless of how many there are.
+      */
+      void remove_dead_particles()
+      {
+        if (store.particles.remove_dead(info, FLType(0)))
+          {
+            reestimate_particle_kernels();
+          }
+      }
+      
+      /*!
+        \brief Sorts the particles according to their cells right away.
+      */
+      void sort_particles()
+      {
+        store.particles.sort_by_cell(info, incremental_sort);
+        steps_since_sort = 0;
       }
       
       
       private:
       
+      std::array<indexer, sizeof...(particles)> species_sizes() const
+      {
+        return {store.particles.template get_particles<particles<num_dims>>().size()...};
+      }
+      
+      void reestimate_particle_kernels()
+      //After the number of particles changes.
+      {
+        store.pusher.initialize(store.particles, store.E_fields, store.B_fields, info);
+        store.depositer.initialize(store.particles, store.currents, info);
+        kernel_size_estimation<0, particles<num_dims>...>();
+      }
+      
+      void synchronize_particles()
+      {
+        if (pending_move != 0)
+          {
+            move_particles(pending_move);
+            pending_move = 0;
+          }
+      }
+      
+      void synchronize_fields()
+      {
+        if constexpr (evolver_is_staggerable<field_evolver>::value)
+          {
+            field_evolver::template synchronize<parallelism>(store.evolver, store.E_fields, store.B_fields, info);
+          }
+      }
+      
+      void discard_pending_B()
+      //For when the magnetic field is replaced from outside.
+      {
+        if constexpr (evolver_is_staggerable<field_evolver>::value)
+          {
+            store.evolver.pending_B = 0;
+          }
+      }
+      
       struct mover_functor
-      //Moves the particles by half a timestep.
+      //Moves the particles by time (usually half a timestep).
       {
         template <class PartArr, class S_Info>
-        CUDA_HOS_DEV void operator() (PartArr &parts, const indexer i, const FLType dt, const S_Info &sys_info) const
+        CUDA_HOS_DEV void operator() (PartArr &parts, const indexer i, const FLType time, const S_Info &sys_info) const
         {
-          parts[i].move(parts[i].vel(sys_info) * dt/2, sys_info);
+          if (parts[i].is_alive(sys_info))
+            {
+              parts[i].move(parts[i].vel(sys_info) * time, sys_info);
+            }
         }
       };
       
@@ -240,29 +589,167 @@ namespace AFFPiCS
       void kernel_size_estimation_single()
       {
         store.move_kernel[idx] = parallelism::template estimate_loop_kernel_size
-                                  <particle_holder<parallelism, part>, mover_functor, FLType, system_info>
+                                  <particle_holder<parallelism, part>, Tracing::traced_t<mover_functor>, FLType, system_info>
                                   (store.particles.template get_particles<part>().size());
       }      
       
       template <indexer idx, class part, class ... parts>
-      void half_move_impl(const FLType dt)
+      void move_impl(const FLType time)
       {
-        half_move_impl_single<idx, part>(dt);
+        move_impl_single<idx, part>(time);
         if constexpr (sizeof...(parts) > 0)
         {
-          half_move_impl<idx, parts...>(dt);
+          move_impl<idx + 1, parts...>(time);
         }
       }
       
       template <indexer idx, class part>
-      void half_move_impl_single(const FLType dt)
+      void move_impl_single(const FLType time)
       {
-        parallelism::loop(store.particles.template get_particles<part>(), mover_functor{}, dt, info);
+        parallelism::loop(store.move_kernel[idx], store.particles.template get_particles<part>(),
+                          Tracing::trace("mover", mover_functor{}), time, info);
+      }
+      
+      void move_particles(const FLType time)
+      {
+        move_impl<0, particles<num_dims>...>(time);
       }
       
       void half_move_particles(const FLType dt)
       {
-        half_move_impl<0, particles<num_dims>...>(dt);
+        move_particles(dt/2);
+      }
+      
+      struct fused_before_deposit
+      //Moves the particles by half a timestep (plus any pending move) and pushes them,
+      //as the first part of the single pass through the particles.
+      {
+        const E_field_holder<parallelism, num_dims> &E_fields;
+        const B_field_holder<parallelism, num_dims> &B_fields;
+        const FLType dt;
+        const FLType lead;
+        const system_info &sys_info;
+        
+        template <class PartArr>
+        CUDA_HOS_DEV void operator() (PartArr &parts, const indexer i) const
+        {
+          mover_functor{}(parts, i, lead, sys_info);
+          typename particle_pusher::particle_functor{}(parts, i, E_fields, B_fields, dt, sys_info);
+        }
+      };
+      
+      struct fused_after_deposit
+      //Moves the particles by the remaining half timestep
+      //(unless it is merged with the next step),
+      //as the last part of the single pass through the particles.
+      {
+        const FLType trail;
+        const system_info &sys_info;
+        
+        template <class PartArr>
+        CUDA_HOS_DEV void operator() (PartArr &parts, const indexer i) const
+        {
+          if (trail != 0)
+            {
+              mover_functor{}(parts, i, trail, sys_info);
+            }
+        }
+      };
+      
+      template <class diagnostics>
+      static constexpr bool can_fuse = stage_is_fusable<particle_pusher>::value           &&
+                                       stage_is_fusable<charge_depositer>::value          &&
+                                       !diagnostic_handler<diagnostics>::before_mover     &&
+                                       !diagnostic_handler<diagnostics>::after_mover      &&
+                                       !diagnostic_handler<diagnostics>::before_pusher    &&
+                                       !diagnostic_handler<diagnostics>::after_pusher     &&
+                                       !diagnostic_handler<diagnostics>::before_evolver   &&
+                                       !diagnostic_handler<diagnostics>::after_evolver    &&
+                                       !diagnostic_handler<diagnostics>::before_depositer &&
+                                       !diagnostic_handler<diagnostics>::after_depositer;
+      //With any of these diagnostics, there would be no appropriate point to call them.
+      
+      template <class diagnostics>
+      static constexpr bool can_merge_moves = !diagnostic_handler<diagnostics>::before_mover &&
+                                              !diagnostic_handler<diagnostics>::after_mover  &&
+                                              !diagnostic_handler<diagnostics>::inject;
+      //The first two would see the particles halfway through the merged move;
+      //with injection, the new particles are placed at the start of the step
+      //and must not be moved by what was pending for the others.
+      
+      template <class diagnostics>
+      static constexpr bool can_stagger_fields = evolver_is_staggerable<field_evolver>::value       &&
+                                                 !pusher_needs_fields<particle_pusher>::value       &&
+                                                 !diagnostic_handler<diagnostics>::before_mover     &&
+                                                 !diagnostic_handler<diagnostics>::after_mover      &&
+                                                 !diagnostic_handler<diagnostics>::before_pusher    &&
+                                                 !diagnostic_handler<diagnostics>::after_evolver    &&
+                                                 !diagnostic_handler<diagnostics>::before_depositer &&
+                                                 !diagnostic_handler<diagnostics>::after_depositer;
+      //These could see the magnetic field half a timestep behind,
+      //as would a pusher that gathers the fields.
+      
+      template <class diagnostics>
+      bool diagnostics_need_synchronization(diagnostics & diag, const FLType dt) const
+      //Whether the diagnostics need the particles and the fields to be synchronized
+      //at the start and at the end of this step.
+      {
+        if constexpr (diagnostic_handler<diagnostics>::pre_step || diagnostic_handler<diagnostics>::post_step)
+          {
+            if constexpr (diagnostic_handler<diagnostics>::synchronized_step)
+              {
+                return diag.synchronized_step(dt, info);
+              }
+            else
+              {
+                return true;
+              }
+          }
+        else
+          {
+            return false;
+          }
+      }
+      
+      template <class results_type>
+      void fused_stages(const FLType dt, const FLType lead, const FLType trail, results_type & ret)
+      //The particles are fully handled before the fields are evolved,
+      //so the new currents must go to a separate array
+      //as the evolver must still use the previous ones.
+      {
+        if (store.next_currents.size() != store.currents.size())
+          {
+            store.next_currents.resize(store.currents.size());
+          }
+          
+        {
+          Timing::scoped_timer timer(ret.timings.fused);
+          Tracing::scope trace_scope("fused");
+          ret.depositer_results = charge_depositer::template deposit_fused<parallelism>
+                                      ( store.depositer, store.next_currents, store.particles, dt, info,
+                                        fused_before_deposit{store.E_fields, store.B_fields, dt, lead, info},
+                                        fused_after_deposit{trail, info}                                  );
+        }
+        
+        {
+          Timing::scoped_timer timer(ret.timings.evolver);
+          Tracing::scope trace_scope("evolver");
+          ret.evolver_results = field_evolver::template evolve<parallelism>
+                              (store.evolver, store.E_fields, store.B_fields, store.currents, dt, info);
+        }
+        
+        using std::swap;
+        swap(store.currents, store.next_currents);
+      }
+      
+      template <class results_type>
+      void finish_step(results_type & ret)
+      {
+        ret.timings.steps = 1;
+        ret.timings.particles_pushed = store.particles.size();
+        ret.timings.cells_updated = store.E_fields.size();
+        total_timings += ret.timings;
+        ++step_number;
       }
       
       public:
@@ -278,8 +765,16 @@ namespace AFFPiCS
       {
         if (initial_condition)
           {
+            discard_pending_B();
             info.initial_condition(store.E_fields, store.B_fields, store.currents, store.particles);
             initialized = true;
+            pending_move = 0;
+            step_number = 0;
+          }
+        else
+          {
+            synchronize_fields();
+            //So that a pending half update of the magnetic field is not lost.
           }
         store.initialize(info);
         kernel_size_estimation<0, particles<num_dims>...>();
@@ -294,6 +789,9 @@ namespace AFFPiCS
         typename particle_pusher::results pusher_results;
         typename field_evolver::results evolver_results;
         typename charge_depositer::results depositer_results;
+        
+        Timing::step_timings timings;
+        //The times are only measured if AFFPICS_TIMING is defined.
       };
       
       /*!
@@ -318,6 +816,7 @@ void DIAGNOSTIC(const particle_storage<parallelism, particles<num_dims>...> &par
        All in all, the execution follows:
 ~~~~~
 diagnostics::pre_step(...);
+diagnostics::inject(...);
 diagnostics::before_mover(...);
 
                     half_move_particles(...)
@@ -348,93 +847,254 @@ diagnostics::post_step(...);
 
 
         With, once again, the diagnostic functions only being called if and only if they exist.
+       
+       If the step is fused (see `set_fused_step`), this becomes:
+~~~~~
+diagnostics::pre_step(...);
+diagnostics::inject(...);
+
+                    for each species:
+                        for each particle:
+                            half_move, push, deposit, half_move
+                    
+                    evolver::evolve(...);
+
+diagnostics::post_step(...);
+~~~~~
+
+       If the moves are merged (see `set_merged_moves`), the last `half_move_particles`
+       is skipped unless the particles must be synchronized at the end of the step,
+       and the first one moves the particles by whatever was skipped in the previous step as well.
+       Similarly, if the fields are staggered (see `set_staggered_fields`), the magnetic field
+       is only synchronized after the evolver when it must be.
+       
+       `inject` (which, unlike the others, can change the particles and also receives the number of the step before `info`)
+       is where the diagnostics can add particles to the system, for instance through
+       the particle sources (see `Sources::FaceInjector` and `Sources::BoxLoader`).
+       The new particles should be placed as they are at the start of the step.
       */
       template <class diagnostics>
       simulation_results simulate_once(const FLType dt, diagnostics & diag)
       {
         simulation_results ret;
         
+        const bool sync_diagnostics = diagnostics_need_synchronization(diag, dt);
+        
+        const bool sync_particles = !merged_moves || !can_merge_moves<diagnostics> || sync_diagnostics;
+        
+        const bool sync_fields = !get_staggered_fields() || !can_stagger_fields<diagnostics> || sync_diagnostics;
+        
+        if (sync_particles)
+          {
+            Timing::scoped_timer timer(ret.timings.mover);
+            Tracing::scope trace_scope("mover");
+            synchronize_particles();
+          }
+        
+        if (sync_fields)
+          {
+            Timing::scoped_timer timer(ret.timings.evolver);
+            Tracing::scope trace_scope("evolver");
+            synchronize_fields();
+          }
+        
+        const FLType lead = pending_move + dt/2, trail = (sync_particles ? dt/2 : FLType(0));
+        //How much the particles are moved at the start and at the end of the step.
+        
+        pending_move = dt/2 - trail;
+        
         if constexpr (diagnostic_handler<diagnostics>::pre_step)
           {
+            Timing::scoped_timer timer(ret.timings.hooks[Timing::pre_step]);
             diag.pre_step(store.particles, store.E_fields, store.B_fields, store.currents, dt, info);
           }
         
+        if constexpr (diagnostic_handler<diagnostics>::inject)
+          {
+            Timing::scoped_timer timer(ret.timings.hooks[Timing::injection]);
+            Tracing::scope trace_scope("injection");
+            const auto before = species_sizes();
+            diag.inject(store.particles, store.E_fields, store.B_fields, store.currents, dt, step_number, info);
+            if (species_sizes() != before)
+              {
+                reestimate_particle_kernels();
+              }
+          }
+        
+        if (remove_particles)
+          {
+            Timing::scoped_timer timer(ret.timings.sorting);
+            Tracing::scope trace_scope("particle removal");
+            if (store.particles.remove_dead(info, removal_threshold))
+              {
+                reestimate_particle_kernels();
+              }
+          }
+        
+        if (sort_interval > 0 && steps_since_sort >= sort_interval)
+          {
+            Timing::scoped_timer timer(ret.timings.sorting);
+            Tracing::scope trace_scope("sorting");
+            sort_particles();
+          }
+        ++steps_since_sort;
+        
+        if (population_interval > 0 && steps_since_population >= population_interval)
+          {
+            Timing::scoped_timer timer(ret.timings.sorting);
+            Tracing::scope trace_scope("population control");
+            if (population_controller.apply(store.particles, population, info))
+              {
+                reestimate_particle_kernels();
+              }
+            steps_since_population = 0;
+          }
+        ++steps_since_population;
+        
+        store.fill_ghosts(info);
+        //The fields may have been changed from outside since the last step.
+        
         if (initialized)
         //If initialized is true, the system has just been put to the initial conditions
         //we must update the currents by half a timestep before moving the particles.
         {
+          Timing::scoped_timer timer(ret.timings.depositer);
+          Tracing::scope trace_scope("depositer");
           ret.depositer_results = charge_depositer::template deposit<parallelism>
                               (store.depositer, store.currents, store.particles, dt/2, info);
           initialized = false;
         }
         
+        if constexpr (can_fuse<diagnostics>)
+          {
+            if (fused_step)
+              {
+                fused_stages(dt, lead, trail, ret);
+                
+                if (sync_fields)
+                  {
+                    Timing::scoped_timer timer(ret.timings.evolver);
+                    Tracing::scope trace_scope("evolver");
+                    synchronize_fields();
+                  }
+                
+                if constexpr (diagnostic_handler<diagnostics>::post_step)
+                  {
+                    Timing::scoped_timer timer(ret.timings.hooks[Timing::post_step]);
+                    diag.post_step(store.particles, store.E_fields, store.B_fields, store.currents, dt, info);
+                  }
+                
+                finish_step(ret);
+                
+                return ret;
+              }
+          }
+        
         if constexpr (diagnostic_handler<diagnostics>::before_mover)
           {
+            Timing::scoped_timer timer(ret.timings.hooks[Timing::before_mover]);
             diag.before_mover(store.particles, store.E_fields, store.B_fields, store.currents, dt, info);
           }
           
-        half_move_particles(dt);
+        {
+          Timing::scoped_timer timer(ret.timings.mover);
+          Tracing::scope trace_scope("mover");
+          move_particles(lead);
+        }
         
         if constexpr (diagnostic_handler<diagnostics>::after_mover)
           {
+            Timing::scoped_timer timer(ret.timings.hooks[Timing::after_mover]);
             diag.after_mover(store.particles, store.E_fields, store.B_fields, store.currents, dt, info);
           }
           
         if constexpr (diagnostic_handler<diagnostics>::before_pusher)
           {
+            Timing::scoped_timer timer(ret.timings.hooks[Timing::before_pusher]);
             diag.before_pusher(store.particles, store.E_fields, store.B_fields, store.currents, dt, info);
           }
           
-        ret.pusher_results = particle_pusher::template push<parallelism>
-                            (store.pusher, store.particles, store.E_fields, store.B_fields, dt, info);
+        {
+          Timing::scoped_timer timer(ret.timings.pusher);
+          Tracing::scope trace_scope("pusher");
+          ret.pusher_results = particle_pusher::template push<parallelism>
+                              (store.pusher, store.particles, store.E_fields, store.B_fields, dt, info);
+        }
                                                         
         if constexpr (diagnostic_handler<diagnostics>::after_pusher)
           {
+            Timing::scoped_timer timer(ret.timings.hooks[Timing::after_pusher]);
             diag.after_pusher(store.particles, store.E_fields, store.B_fields, store.currents, dt, info);
           }
                                        
         if constexpr (diagnostic_handler<diagnostics>::before_evolver)
           {
+            Timing::scoped_timer timer(ret.timings.hooks[Timing::before_evolver]);
             diag.before_evolver(store.particles, store.E_fields, store.B_fields, store.currents, dt, info);
           }
           
-        ret.evolver_results = field_evolver::template evolve<parallelism>
-                            (store.evolver, store.E_fields, store.B_fields, store.currents, dt, info);
+        {
+          Timing::scoped_timer timer(ret.timings.evolver);
+          Tracing::scope trace_scope("evolver");
+          ret.evolver_results = field_evolver::template evolve<parallelism>
+                              (store.evolver, store.E_fields, store.B_fields, store.currents, dt, info);
+          if (sync_fields)
+            {
+              synchronize_fields();
+            }
+        }
         
         if constexpr (diagnostic_handler<diagnostics>::after_evolver)
           {
+            Timing::scoped_timer timer(ret.timings.hooks[Timing::after_evolver]);
             diag.after_evolver(store.particles, store.E_fields, store.B_fields, store.currents, dt, info);
           }
           
         if constexpr (diagnostic_handler<diagnostics>::before_depositer)
           {
+            Timing::scoped_timer timer(ret.timings.hooks[Timing::before_depositer]);
             diag.before_depositer(store.particles, store.E_fields, store.B_fields, store.currents, dt, info);
           }
           
-        ret.depositer_results = charge_depositer::template deposit<parallelism>
-                            (store.depositer, store.currents, store.particles, dt, info);
+        {
+          Timing::scoped_timer timer(ret.timings.depositer);
+          Tracing::scope trace_scope("depositer");
+          ret.depositer_results = charge_depositer::template deposit<parallelism>
+                              (store.depositer, store.currents, store.particles, dt, info);
+        }
         
         if constexpr (diagnostic_handler<diagnostics>::after_depositer)
           {
+            Timing::scoped_timer timer(ret.timings.hooks[Timing::after_depositer]);
             diag.after_depositer(store.particles, store.E_fields, store.B_fields, store.currents, dt, info);
           }
         
         if constexpr (diagnostic_handler<diagnostics>::before_mover)
           {
+            Timing::scoped_timer timer(ret.timings.hooks[Timing::before_mover]);
             diag.before_mover(store.particles, store.E_fields, store.B_fields, store.currents, dt, info);
           }
           
-        half_move_particles(dt);
+        if (trail != 0)
+          {
+            Timing::scoped_timer timer(ret.timings.mover);
+            Tracing::scope trace_scope("mover");
+            move_particles(trail);
+          }
         
         if constexpr (diagnostic_handler<diagnostics>::after_mover)
           {
+            Timing::scoped_timer timer(ret.timings.hooks[Timing::after_mover]);
             diag.after_mover(store.particles, store.E_fields, store.B_fields, store.currents, dt, info);
           }
           
         if constexpr (diagnostic_handler<diagnostics>::post_step)
           {
+            Timing::scoped_timer timer(ret.timings.hooks[Timing::post_step]);
             diag.post_step(store.particles, store.E_fields, store.B_fields, store.currents, dt, info);
           }
+        
+        finish_step(ret);
           
         return ret;
       }
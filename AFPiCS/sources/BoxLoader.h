@@ -0,0 +1,138 @@
+#ifndef AFFPICS_SOURCES_BOX_LOADER
+#define AFFPICS_SOURCES_BOX_LOADER
+
+/*!
+  \file BoxLoader.h
+  
+  \brief Loads thermal particles uniformly inside a box of cells.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include "../utilities/particle_storage.h"
+#include "../utilities/random.h"
+#include "box_sampling.h"
+#include "cell_injection.h"
+
+namespace AFFPiCS
+{
+  namespace Sources
+  {
+    /*!
+      \brief Creates particles of type \p particle, uniformly distributed
+             in the cells from `cell_begin` (inclusive) to `cell_end` (exclusive),
+             with momenta following a Maxwell-Juttner distribution.
+      
+      \remark The number of particles in each cell is the average rounded up or down at random
+              (with the probabilities that keep the average), so that rates
+              below one particle per cell and step still work.
+      
+      \remark The particles do not depend on the number of threads (see `cell_injector`).
+      
+      \remark Meant to be called from the `inject` function of the diagnostics
+              (see `Simulation::simulate_once`).
+    */
+    template <class parallelism, class particle>
+    class BoxLoader
+    {
+      public:
+      
+      static constexpr indexer num_dims = particle::num_dimensions;
+      
+      private:
+      
+      vector_type<indexer, num_dims> cell_begin, cell_end;
+      
+      FLType rate;
+      //The average number of particles created per cell per unit time.
+      
+      FLType temperature;
+      //k T / (m c^2)
+      
+      uint64_t seed;
+      
+      cell_injector<parallelism> injector;
+      
+      struct box_source
+      {
+        template <class S_Info>
+        CUDA_HOS_DEV static indexer count(Random::counter_stream &rng,
+                                          const indexer i,
+                                          const vector_type<indexer, num_dims> &begin,
+                                          const vector_type<indexer, num_dims> &extent,
+                                          const FLType per_cell,
+                                          const FLType theta,
+                                          const S_Info &info)
+        {
+          using namespace std;
+          
+          return indexer(floor(per_cell + 1 - rng.uniform()));
+        }
+        
+        template <class PartArr, class S_Info>
+        CUDA_HOS_DEV static void fill(Random::counter_stream &rng,
+                                      PartArr &parts,
+                                      const indexer first,
+                                      const indexer count,
+                                      const indexer i,
+                                      const vector_type<indexer, num_dims> &begin,
+                                      const vector_type<indexer, num_dims> &extent,
+                                      const FLType per_cell,
+                                      const FLType theta,
+                                      const S_Info &info)
+        {
+          const vector_type<indexer, num_dims> cell = BoxSampling::box_cell<num_dims>(i, begin, extent);
+          
+          for (indexer k = 0; k < count; ++k)
+            {
+              parts[first + k] = BoxSampling::thermal_particle<particle>(rng, cell, theta, info);
+            }
+        }
+      };
+      
+      public:
+      
+      /*!
+        \param begin, end The box of cells where the particles are created.
+        
+        \param particles_per_time The average number of particles created in each cell per unit time.
+        
+        \param theta The temperature, as k T / (m c^2).
+        
+        \param rng_seed Identifies the random streams of this source.
+      */
+      BoxLoader(const vector_type<indexer, num_dims> &begin, const vector_type<indexer, num_dims> &end,
+                const FLType particles_per_time, const FLType theta, const uint64_t rng_seed):
+      cell_begin(begin), cell_end(end), rate(particles_per_time), temperature(theta), seed(rng_seed)
+      {
+      }
+      
+      /*!
+        \brief Creates, in each cell, \p per_cell particles on average.
+        
+        \return The number of particles created.
+      */
+      template <class part_storage, class system_info>
+      indexer load(part_storage &storage, const FLType per_cell, const indexer step, const system_info &info)
+      {
+        return injector.template inject<box_source>("box loader", storage.template get_part<particle>(),
+                                                    (cell_end - cell_begin).multiply_all(), seed, step,
+                                                    cell_begin, cell_end - cell_begin, per_cell, temperature, info);
+      }
+      
+      /*!
+        \brief Creates the particles for a timestep \p dt.
+        
+        \return The number of particles created.
+      */
+      template <class part_storage, class system_info>
+      indexer inject(part_storage &storage, const FLType dt, const indexer step, const system_info &info)
+      {
+        return load(storage, rate * dt, step, info);
+      }
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,172 @@
+#ifndef AFFPICS_SOURCES_FACE_INJECTOR
+#define AFFPICS_SOURCES_FACE_INJECTOR
+
+/*!
+  \file FaceInjector.h
+  
+  \brief Injects thermal particles through one of the faces of the system,
+         as if there were a plasma at rest just outside of it.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include "../utilities/particle_storage.h"
+#include "../utilities/random.h"
+#include "maxwell_juttner.h"
+#include "cell_injection.h"
+
+namespace AFFPiCS
+{
+  namespace Sources
+  {
+    /*!
+      \brief Creates particles of type \p particle entering the system through the face
+             normal to dimension `dim` (the lower or the upper one),
+             with the number and momenta of the particles of a Maxwell-Juttner distribution
+             that cross it (so the momenta are weighted by the normal velocity).
+      
+      \remark Each particle crosses the face at a random time within the step,
+              so it is created already moved by the corresponding distance
+              (and with the boundary conditions applied, if that takes it out of the system again).
+      
+      \remark The number of particles crossing each cell of the face in a step
+              is rounded up or down at random, keeping the average flux,
+              and does not depend on the number of threads (see `cell_injector`).
+      
+      \remark Meant to be called from the `inject` function of the diagnostics
+              (see `Simulation::simulate_once`).
+    */
+    template <class parallelism, class particle>
+    class FaceInjector
+    {
+      public:
+      
+      static constexpr indexer num_dims = particle::num_dimensions;
+      
+      private:
+      
+      indexer dim;
+      
+      bool upper;
+      
+      FLType density;
+      //In particles per cell.
+      
+      FLType temperature;
+      //k T / (m c^2)
+      
+      FLType flux;
+      //The particles crossing the face per unit area and time, divided by the density and c.
+      
+      uint64_t seed;
+      
+      cell_injector<parallelism> injector;
+      
+      struct face_source
+      {
+        template <class S_Info>
+        CUDA_HOS_DEV static indexer count(Random::counter_stream &rng,
+                                          const indexer i,
+                                          const indexer normal_dim,
+                                          const bool at_upper,
+                                          const FLType per_cell,
+                                          const FLType theta,
+                                          const FLType dt,
+                                          const S_Info &info)
+        {
+          using namespace std;
+          
+          return indexer(floor(per_cell + 1 - rng.uniform()));
+        }
+        
+        template <class PartArr, class S_Info>
+        CUDA_HOS_DEV static void fill(Random::counter_stream &rng,
+                                      PartArr &parts,
+                                      const indexer first,
+                                      const indexer count,
+                                      const indexer i,
+                                      const indexer normal_dim,
+                                      const bool at_upper,
+                                      const FLType per_cell,
+                                      const FLType theta,
+                                      const FLType dt,
+                                      const S_Info &info)
+        {
+          vector_type<indexer, num_dims> cell;
+          indexer rest = i;
+          for (indexer d = 0; d < num_dims; ++d)
+            {
+              if (d == normal_dim)
+                {
+                  cell[d] = (at_upper ? info.num_cells(d) : 0);
+                  //At the upper face, the particles start just outside,
+                  //so that any (negative) move brings them in.
+                }
+              else
+                {
+                  cell[d] = rest % info.num_cells(d);
+                  rest /= info.num_cells(d);
+                }
+            }
+          
+          const FLType c = info.units().c();
+          
+          for (indexer k = 0; k < count; ++k)
+            {
+              vector_type<FLType, num_dims> pos;
+              for (indexer d = 0; d < num_dims; ++d)
+                {
+                  pos[d] = (d == normal_dim ? FLType(0) : 1 - rng.uniform());
+                }
+              const FLType u = MaxwellJuttner::sample_flux_momentum(rng, theta);
+              particle part(cell, pos);
+              part.set_u(MaxwellJuttner::flux_direction<num_dims>(rng, u, normal_dim, (at_upper ? -1 : 1)) * c, info);
+              part.move(part.vel(info) * (dt * rng.uniform()), info);
+              parts[first + k] = part;
+            }
+        }
+      };
+      
+      public:
+      
+      /*!
+        \param normal_dim The dimension to which the face is normal.
+        
+        \param at_upper If `true`, the particles enter through the face at `num_cells(normal_dim)`,
+                        otherwise through the one at 0.
+        
+        \param particles_per_cell The density of the plasma outside the face.
+        
+        \param theta The temperature, as k T / (m c^2).
+        
+        \param rng_seed Identifies the random streams of this source.
+      */
+      FaceInjector(const indexer normal_dim, const bool at_upper, const FLType particles_per_cell,
+                   const FLType theta, const uint64_t rng_seed):
+      dim(normal_dim), upper(at_upper), density(particles_per_cell), temperature(theta),
+      flux(MaxwellJuttner::flux_over_density(theta)), seed(rng_seed)
+      {
+      }
+      
+      /*!
+        \brief Creates the particles that enter the system during a timestep \p dt.
+        
+        \return The number of particles created.
+      */
+      template <class part_storage, class system_info>
+      indexer inject(part_storage &storage, const FLType dt, const indexer step, const system_info &info)
+      {
+        const indexer face_cells = info.total_cells() / info.num_cells(dim);
+        
+        const FLType per_cell = density * flux * info.units().c() * dt / info.cell_sizes()[dim];
+        
+        return injector.template inject<face_source>("face injector", storage.template get_part<particle>(),
+                                                     face_cells, seed, step,
+                                                     dim, upper, per_cell, temperature, dt, info);
+      }
+    };
+  }
+}
+
+#endif
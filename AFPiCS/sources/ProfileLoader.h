@@ -0,0 +1,152 @@
+#ifndef AFFPICS_SOURCES_PROFILE_LOADER
+#define AFFPICS_SOURCES_PROFILE_LOADER
+
+/*!
+  \file ProfileLoader.h
+  
+  \brief Loads thermal particles following a density profile
+         with the same number of particles in every cell and varying weights.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include "../utilities/particle_storage.h"
+#include "../utilities/random.h"
+#include "box_sampling.h"
+#include "cell_injection.h"
+
+namespace AFFPiCS
+{
+  namespace Sources
+  {
+    /*!
+      \brief Creates `particles_per_cell` particles of type \p particle in each cell
+             from `cell_begin` (inclusive) to `cell_end` (exclusive) where \p Profile is positive,
+             uniformly distributed in the cell, with momenta following a Maxwell-Juttner distribution
+             and weights such that the density follows \p Profile.
+      
+      \pre \p particle must have weights (see `Particles::particle_weighted`).
+      
+      \remark \p Profile is called as `FLType Profile::operator() (const vector_type<FLType, num_dims> &absolute_pos) const`
+              and gives the density in particles of unit weight per cell at that position,
+              so, where it is low, the particles are simply lighter instead of fewer.
+      
+      \remark Whether a cell gets particles is decided by \p Profile at its centre,
+              so a particle near the edge of the plasma may still fall where \p Profile vanishes,
+              in which case it is created dead (see `particle_storage::remove_dead`).
+    */
+    template <class parallelism, class particle, class Profile>
+    class ProfileLoader
+    {
+      public:
+      
+      static constexpr indexer num_dims = particle::num_dimensions;
+      
+      static_assert(particle_is_weighted<particle>::value, "The particles must have weights!");
+      
+      private:
+      
+      vector_type<indexer, num_dims> cell_begin, cell_end;
+      
+      indexer per_cell;
+      
+      Profile profile;
+      
+      FLType temperature;
+      //k T / (m c^2)
+      
+      uint64_t seed;
+      
+      cell_injector<parallelism> injector;
+      
+      struct profile_source
+      {
+        template <class S_Info>
+        CUDA_HOS_DEV static indexer count(Random::counter_stream &rng,
+                                          const indexer i,
+                                          const vector_type<indexer, num_dims> &begin,
+                                          const vector_type<indexer, num_dims> &extent,
+                                          const indexer per_cell,
+                                          const Profile &prof,
+                                          const FLType theta,
+                                          const S_Info &info)
+        {
+          const vector_type<indexer, num_dims> cell = BoxSampling::box_cell<num_dims>(i, begin, extent);
+          
+          return (prof((vector_type<FLType, num_dims>(cell) + vector_type<FLType, num_dims>(FLType(0.5))).element_multiply(info.cell_sizes())) > 0 ? per_cell : 0);
+          //No particles where there is no plasma.
+        }
+        
+        template <class PartArr, class S_Info>
+        CUDA_HOS_DEV static void fill(Random::counter_stream &rng,
+                                      PartArr &parts,
+                                      const indexer first,
+                                      const indexer count,
+                                      const indexer i,
+                                      const vector_type<indexer, num_dims> &begin,
+                                      const vector_type<indexer, num_dims> &extent,
+                                      const indexer per_cell,
+                                      const Profile &prof,
+                                      const FLType theta,
+                                      const S_Info &info)
+        {
+          const vector_type<indexer, num_dims> cell = BoxSampling::box_cell<num_dims>(i, begin, extent);
+          
+          for (indexer k = 0; k < count; ++k)
+            {
+              particle part = BoxSampling::thermal_particle<particle>(rng, cell, theta, info);
+              const FLType w = prof(part.absolute_pos(info)) / count;
+              if (w > 0)
+                {
+                  part.set_weight(w, info);
+                }
+              else
+              //Only possible at the edges of the profile.
+                {
+                  part.kill(info);
+                }
+              parts[first + k] = part;
+            }
+        }
+      };
+      
+      public:
+      
+      /*!
+        \param begin, end The box of cells where the particles are created.
+        
+        \param particles_per_cell The number of particles created in each cell (where the density is positive).
+        
+        \param prof The density, in particles of unit weight per cell.
+        
+        \param theta The temperature, as k T / (m c^2).
+        
+        \param rng_seed Identifies the random streams of this source.
+      */
+      ProfileLoader(const vector_type<indexer, num_dims> &begin, const vector_type<indexer, num_dims> &end,
+                    const indexer particles_per_cell, const Profile &prof, const FLType theta, const uint64_t rng_seed):
+      cell_begin(begin), cell_end(end), per_cell(particles_per_cell), profile(prof), temperature(theta), seed(rng_seed)
+      {
+      }
+      
+      /*!
+        \brief Creates the particles.
+        
+        \param step Identifies the random streams (together with the seed),
+                    so loading again at the same step gives the same particles.
+        
+        \return The number of particles created.
+      */
+      template <class part_storage, class system_info>
+      indexer load(part_storage &storage, const indexer step, const system_info &info)
+      {
+        return injector.template inject<profile_source>("profile loader", storage.template get_part<particle>(),
+                                                        (cell_end - cell_begin).multiply_all(), seed, step,
+                                                        cell_begin, cell_end - cell_begin, per_cell, profile, temperature, info);
+      }
+    };
+  }
+}
+
+#endif
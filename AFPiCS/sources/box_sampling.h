@@ -0,0 +1,66 @@
+#ifndef AFFPICS_SOURCES_BOX_SAMPLING
+#define AFFPICS_SOURCES_BOX_SAMPLING
+
+/*!
+  \file box_sampling.h
+  
+  \brief What is common to the sources that fill a box of cells with thermal particles
+         (see `Sources::BoxLoader` and `Sources::ProfileLoader`).
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include "../utilities/random.h"
+#include "maxwell_juttner.h"
+
+namespace AFFPiCS
+{
+  namespace Sources
+  {
+    namespace BoxSampling
+    {
+      /*!
+        \brief The cell with linear index \p i (with the first dimension varying fastest)
+               in the box of \p extent cells starting at \p begin.
+      */
+      template <indexer num_dims>
+      CUDA_HOS_DEV inline vector_type<indexer, num_dims> box_cell(const indexer i,
+                                                                  const vector_type<indexer, num_dims> &begin,
+                                                                  const vector_type<indexer, num_dims> &extent)
+      {
+        vector_type<indexer, num_dims> cell;
+        indexer rest = i;
+        for (indexer d = 0; d < num_dims; ++d)
+          {
+            cell[d] = begin[d] + rest % extent[d];
+            rest /= extent[d];
+          }
+        return cell;
+      }
+      
+      /*!
+        \brief A particle uniformly distributed in \p cell,
+               with its momentum following a Maxwell-Juttner distribution of temperature \p theta.
+      */
+      template <class particle, indexer num_dims, class S_Info>
+      CUDA_HOS_DEV inline particle thermal_particle(Random::counter_stream &rng,
+                                                    const vector_type<indexer, num_dims> &cell,
+                                                    const FLType theta,
+                                                    const S_Info &info)
+      {
+        vector_type<FLType, num_dims> pos;
+        for (indexer d = 0; d < num_dims; ++d)
+          {
+            pos[d] = 1 - rng.uniform();
+          }
+        const FLType u = MaxwellJuttner::sample_momentum(rng, theta);
+        particle ret(cell, pos);
+        ret.set_u(MaxwellJuttner::isotropic<num_dims>(rng, u) * info.units().c(), info);
+        return ret;
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef AFFPICS_SOURCES_CELL_INJECTION
+#define AFFPICS_SOURCES_CELL_INJECTION
+
+/*!
+  \file cell_injection.h
+  
+  \brief What is common to the sources that create particles cell by cell
+         (see `Sources::BoxLoader`, `Sources::ProfileLoader` and `Sources::FaceInjector`).
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include "../utilities/random.h"
+#include "../utilities/tracing.h"
+#include "../utilities/stream_compaction.h"
+
+namespace AFFPiCS
+{
+  namespace Sources
+  {
+    /*!
+      \brief Creates the particles of a source in two passes over its cells:
+             the first one counts the particles of each cell,
+             whose prefix sum then gives each cell its own range of slots,
+             and the second one fills them.
+      
+      \remark \p Source must provide
+              `static indexer count(Random::counter_stream &rng, const indexer i, const Args& ... args)`
+              and `static void fill(Random::counter_stream &rng, PartArr &parts, const indexer first, const indexer count, const indexer i, const Args& ... args)`,
+              which fills the slots from `first` to `first + count` with the particles of cell `i`.
+              Both must be `CUDA_HOS_DEV`.
+      
+      \remark The random numbers for each cell come from their own stream
+              (see `Random::counter_stream`), identified by the seed, the step and the cell,
+              and `count` is called again (on the same stream) before `fill`,
+              so the particles that are created, and where they are stored,
+              do not depend on the number of threads.
+              Different sources should have different seeds.
+    */
+    template <class parallelism>
+    class cell_injector
+    {
+      public:
+      
+      using index_array = g24_lib::array_parallel<parallelism, indexer>;
+      
+      private:
+      
+      index_array offsets;
+      //Holds the counts and then, after the scan, the offsets of each cell.
+      
+      index_scanner<parallelism> scanner;
+      
+      template <class Source>
+      struct count_functor
+      {
+        template <class OffsetArr, class ... Args>
+        CUDA_HOS_DEV void operator() (OffsetArr &counts, const indexer i, const uint64_t rng_seed, const indexer step, const Args& ... args) const
+        {
+          Random::counter_stream rng(rng_seed, step, i);
+          
+          counts[i] = Source::count(rng, i, args...);
+        }
+      };
+      
+      template <class Source>
+      struct fill_functor
+      {
+        template <class OffsetArr, class PartArr, class ... Args>
+        CUDA_HOS_DEV void operator() (const OffsetArr &offs,
+                                      const indexer i,
+                                      PartArr &parts,
+                                      const indexer first,
+                                      const uint64_t rng_seed,
+                                      const indexer step,
+                                      const Args& ... args) const
+        {
+          Random::counter_stream rng(rng_seed, step, i);
+          
+          const indexer count = Source::count(rng, i, args...);
+          
+          if (count > 0)
+            {
+              Source::fill(rng, parts, first + offs[i], count, i, args...);
+            }
+        }
+      };
+      
+      public:
+      
+      /*!
+        \brief Creates the particles of \p Source in \p num_cells cells
+               and stores them at the end of \p part (a `particle_storage_part`).
+        
+        \param name Identifies the filling kernel for `Tracing`.
+        
+        \return The number of particles created.
+      */
+      template <class Source, class part_storage_part, class ... Args>
+      indexer inject(const char * name, part_storage_part &part, const indexer num_cells,
+                     const uint64_t rng_seed, const indexer step, const Args& ... args)
+      {
+        if (offsets.size() != num_cells)
+          {
+            offsets.resize(num_cells);
+          }
+        
+        parallelism::loop(offsets, count_functor<Source>{}, rng_seed, step, args...);
+        
+        const indexer total = scanner.exclusive_scan(offsets);
+        
+        if (total <= 0)
+          {
+            return 0;
+          }
+        
+        part.reserve_injection(total);
+        
+        const indexer first = part.particles.claim(total);
+        //A single claim, so that the order does not depend on the threads.
+        
+        if (first >= 0)
+          {
+            parallelism::loop(offsets, Tracing::trace(name, fill_functor<Source>{}), part.particles, first, rng_seed, step, args...);
+          }
+        
+        return total - part.commit_injection();
+      }
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef AFFPICS_SOURCES_MAXWELL_JUTTNER
+#define AFFPICS_SOURCES_MAXWELL_JUTTNER
+
+/*!
+  \file maxwell_juttner.h
+  
+  \brief Sampling of the (relativistic) Maxwell-Juttner distribution,
+         both as it is in a volume and as it is seen crossing a surface,
+         for the particle sources.
+  
+  \remark The temperature is always given as \f$ \theta = k T / (m c^2) \f$
+          and the momenta are returned as \f$ u = \gamma v / c \f$,
+          so everything here is independent of the unit system.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include "../utilities/random.h"
+#include <cmath>
+
+namespace AFFPiCS
+{
+  namespace Sources
+  {
+    namespace MaxwellJuttner
+    {
+      /*!
+        \brief Returns \f$ e^x K_2(x) \f$, with \f$ K_2 \f$ the modified Bessel function of the second kind.
+        
+        \remark Computed through the trapezoidal rule on \f$ \int_0^\infty e^{-x (\cosh t - 1)} \cosh 2t \, dt \f$,
+                which converges exponentially fast and never overflows.
+                For large \f$ x \f$ (low temperatures), the integrand is a peak of width \f$ 1/\sqrt{x} \f$,
+                so the step shrinks accordingly and the number of points stays bounded.
+      */
+      inline FLType scaled_bessel_k2(const FLType x)
+      {
+        using namespace std;
+        const FLType h = min(FLType(1)/64, FLType(0.25)/sqrt(x));
+        FLType ret = FLType(0.5);
+        //Half of the integrand at t = 0.
+        for (indexer i = 1; ; ++i)
+          {
+            const FLType t = i * h;
+            const FLType expo = -x * (cosh(t) - 1) + 2 * t;
+            ret += exp(-x * (cosh(t) - 1)) * cosh(2 * t);
+            if (expo < -40 && x * sinh(t) > 2)
+            //Past the maximum and already negligible.
+              {
+                break;
+              }
+          }
+        return ret * h;
+      }
+      
+      /*!
+        \brief The particles that cross a surface per unit time and area
+               (in one direction), divided by the density and the speed of light.
+      */
+      inline FLType flux_over_density(const FLType theta)
+      {
+        return theta * (theta + 1) / (2 * scaled_bessel_k2(FLType(1) / theta));
+      }
+      
+      /*!
+        \brief Samples the magnitude of the momentum of a particle in a (3D) Maxwell-Juttner distribution.
+        
+        \remark Above \f$ \theta = 1 \f$, Sobol's algorithm is used;
+                below, where it gets too inefficient, the kinetic energy is sampled
+                by rejection from a mixture of Gamma distributions,
+                whose acceptance tends to 1 as the temperature decreases.
+      */
+      CUDA_HOS_DEV inline FLType sample_momentum(Random::counter_stream &rng, const FLType theta)
+      {
+        using namespace std;
+        if (theta >= 1)
+          {
+            while (true)
+              {
+                const FLType x123 = rng.uniform() * rng.uniform() * rng.uniform();
+                const FLType u = -theta * log(x123);
+                const FLType eta = -theta * log(x123 * rng.uniform());
+                if (eta * eta - u * u > 1)
+                  {
+                    return u;
+                  }
+              }
+          }
+        else
+          {
+            constexpr FLType sqrt2 = FLType(1.4142135623730951);
+            const FLType w0 = sqrt2 / 2, w1 = 15 / (8 * sqrt2) * theta, w2 = 15 / (16 * sqrt2) * theta * theta;
+            //The weights of t^(k+1/2) exp(-t/theta), for k = 0, 1, 2,
+            //in the envelope (1 + t) sqrt(t) (sqrt(2) + t/(2 sqrt(2))) exp(-t/theta)
+            //of the distribution of t = gamma - 1, (1 + t) sqrt(t (t + 2)) exp(-t/theta).
+            while (true)
+              {
+                const FLType choice = rng.uniform() * (w0 + w1 + w2);
+                const indexer k = (choice <= w0 ? 0 : (choice <= w0 + w1 ? 1 : 2));
+                const FLType t = theta * rng.gamma_half(2 * k + 3);
+                if (rng.uniform() * (sqrt2 + t / (2 * sqrt2)) <= sqrt(t + 2))
+                  {
+                    return sqrt(t * (t + 2));
+                  }
+              }
+          }
+      }
+      
+      /*!
+        \brief Samples the magnitude of the momentum of a particle of a Maxwell-Juttner distribution
+               that crosses a surface (that is, weighted by the normal velocity).
+        
+        \remark The kinetic energy \f$ t \f$ is distributed as \f$ (t^2 + 2 t) e^{-t/\theta} \f$,
+                a mixture of two Gamma distributions, so this is exact and needs no rejection.
+      */
+      CUDA_HOS_DEV inline FLType sample_flux_momentum(Random::counter_stream &rng, const FLType theta)
+      {
+        using namespace std;
+        const FLType t = theta * rng.gamma_half(rng.uniform() * (theta + 1) <= theta ? 6 : 4);
+        return sqrt(t * (t + 2));
+      }
+      
+      /*!
+        \brief Gives the momentum \p u an isotropic direction.
+        
+        \remark With fewer than three dimensions, the extra components are discarded
+                (as the projection of the three-dimensional distribution).
+      */
+      template <indexer num_dims>
+      CUDA_HOS_DEV inline vector_type<FLType, num_dims> isotropic(Random::counter_stream &rng, const FLType u)
+      {
+        using namespace std;
+        const FLType cos_a = 2 * rng.uniform() - 1;
+        const FLType sin_a = sqrt(1 - cos_a * cos_a);
+        const FLType phi = 2 * g24_lib::pi<FLType> * rng.uniform();
+        const FLType full[3] = {u * sin_a * cos(phi), u * sin_a * sin(phi), u * cos_a};
+        vector_type<FLType, num_dims> ret;
+        for (indexer d = 0; d < num_dims; ++d)
+          {
+            ret[d] = full[d];
+          }
+        return ret;
+      }
+      
+      /*!
+        \brief Gives the momentum \p u the direction of a particle crossing a surface
+               normal to dimension \p dim, in the direction given by the sign of \p sign
+               (the normal component following Lambert's cosine law).
+        
+        \remark With fewer than three dimensions, the extra tangential components are discarded.
+      */
+      template <indexer num_dims>
+      CUDA_HOS_DEV inline vector_type<FLType, num_dims> flux_direction(Random::counter_stream &rng, const FLType u,
+                                                                       const indexer dim, const FLType sign)
+      {
+        using namespace std;
+        const FLType cos2_a = rng.uniform();
+        const FLType normal = u * sqrt(cos2_a), tangential = u * sqrt(1 - cos2_a);
+        const FLType phi = 2 * g24_lib::pi<FLType> * rng.uniform();
+        const FLType tangents[2] = {tangential * cos(phi), tangential * sin(phi)};
+        vector_type<FLType, num_dims> ret;
+        indexer j = 0;
+        for (indexer d = 0; d < num_dims; ++d)
+          {
+            ret[d] = (d == dim ? sign * normal : tangents[j++]);
+          }
+        return ret;
+      }
+    }
+  }
+}
+
+#endif
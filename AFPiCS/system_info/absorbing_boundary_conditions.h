@@ -0,0 +1,105 @@
+#ifndef AFFPICS_SYSTEM_INFO_ABSORBING_BOUNDARY
+#define AFFPICS_SYSTEM_INFO_ABSORBING_BOUNDARY
+
+/*!
+  \file absorbing_boundary_conditions.h
+  
+  \brief A system with absorbing (outflow) boundary conditions.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include "system_info_base.h"
+
+namespace AFFPiCS
+{
+  namespace SystemDefinitions
+  {
+    /*!
+      \brief The particles that leave the system are killed
+             (see `particle_base::kill`) and the fields outside of it are zero.
+      
+      \remark The dead particles stay in the storage until they are removed
+              with `particle_storage::remove_dead` (see `Simulation::set_particle_removal`).
+    */
+    template <indexer num_dims, class derived = void>
+    class AbsorbingBoundaryConditions
+    {
+      private:
+      
+      using deriv_t = std::conditional_t<std::is_void_v<derived>, AbsorbingBoundaryConditions, derived>;
+      
+      template <indexer dim, bool check_for_border, class Func, class ... Args>
+      CUDA_HOS_DEV void for_all_neighbours_impl( const indexer radius,
+                                                 const vector_type<indexer, num_dims> &cell,
+                                                 Func && func, Args&& ... args                             ) const
+      {
+        const deriv_t* dhis = static_cast<const deriv_t*>(this);
+        if constexpr (dim == num_dims)
+          {
+            func(dhis->to_index(cell), cell, vector_type<bool, num_dims>(false), std::forward<Args>(args)...);
+          }
+        else if constexpr (dim < num_dims)
+          {
+            indexer start = cell[dim] - radius, end = cell[dim] + radius;
+            if constexpr (check_for_border)
+            //The cells outside the system are simply skipped.
+              {
+                start = (start < 0 ? 0 : start);
+                end = (end >= dhis->num_cells(dim) ? dhis->num_cells(dim) - 1 : end);
+              }
+            for (indexer i = start; i <= end; ++i)
+              {
+                for_all_neighbours_impl<dim + 1, check_for_border, Func, Args...>
+                  (radius, cell.set(dim, i), std::forward<Func>(func), std::forward<Args>(args)...);
+              }
+          }
+      }
+      
+      public:
+      
+      template <bool check_for_border = true, class Func, class ... Args>
+      CUDA_HOS_DEV void for_all_neighbours( const indexer radius,
+                                            const vector_type<indexer, num_dims> &cell,
+                                            Func && func, Args&& ... args                             ) const
+      {
+        for_all_neighbours_impl<0, check_for_border, Func, Args...>
+                          (radius, cell, std::forward<Func>(func), std::forward<Args>(args)...);
+      }
+      
+      template <class particle>
+      CUDA_HOS_DEV void boundary_particles (particle& part, const bool force_apply = false) const
+      {
+        const deriv_t* dhis = static_cast<const deriv_t*>(this);
+        if (force_apply || dhis->is_outside(part.cell(*dhis)))
+          {
+            part.kill(*dhis);
+          }
+      }
+      
+      template <class ArrT>
+      CUDA_HOS_DEV E_field_type<num_dims> boundary_E(const vector_type<indexer, num_dims> &,
+                                                     const ArrT &                                               ) const
+      {
+        return E_field_type<num_dims>(FLType(0));
+      }
+      
+      template <class ArrT>
+      CUDA_HOS_DEV B_field_type<num_dims> boundary_B(const vector_type<indexer, num_dims> &,
+                                                     const ArrT &                                               ) const
+      {
+        return B_field_type<num_dims>(FLType(0));
+      }
+      
+      template <class ArrT>
+      CUDA_HOS_DEV current_type<num_dims> boundary_J(const vector_type<indexer, num_dims> &,
+                                                     const ArrT &                                               ) const
+      {
+        return current_type<num_dims>(FLType(0));
+      }
+    };
+  }
+}
+
+#endif
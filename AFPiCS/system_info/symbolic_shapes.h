@@ -15,6 +15,7 @@
 #include "system_info_base.h"
 #include "simbpolic.h"
 #include "../utilities/interpolators.h"
+#include "../utilities/ghost_cells.h"
 
 namespace AFFPiCS
 {
@@ -268,7 +269,7 @@ namespace AFFPiCS
         template <indexer dim, class ArrT>
         CUDA_HOS_DEV static inline auto eval(const deriv_t* dhis, const vector_type<indexer, num_dims> &cell, const ArrT& array)
         {
-          return dhis->boundary_E(cell, array)[dim];
+          return E_at(*dhis, cell, array)[dim];
         }
         
         CUDA_HOS_DEV static inline auto pos(const deriv_t* dhis, const indexer dim)
@@ -283,7 +284,7 @@ namespace AFFPiCS
         template <indexer dim, class ArrT>
         CUDA_HOS_DEV static inline auto eval(const deriv_t* dhis, const vector_type<indexer, num_dims> &cell, const ArrT& array)
         {
-          return dhis->boundary_B(cell, array)[dim];
+          return B_at(*dhis, cell, array)[dim];
         }
         
         CUDA_HOS_DEV static inline auto pos(const deriv_t* dhis, const indexer dim)
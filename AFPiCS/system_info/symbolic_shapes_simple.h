@@ -16,6 +16,7 @@
 #include "system_info_base.h"
 #include "simbpolic.h"
 #include "../utilities/interpolators.h"
+#include "../utilities/ghost_cells.h"
 
 namespace AFFPiCS
 {
@@ -56,14 +57,19 @@ namespace AFFPiCS
      public:
       
       template <class part_type>
-      CUDA_HOS_DEV inline FLType particle_fraction(const part_type& part, const vector_type<FLType, num_dims> &pos) const
+      CUDA_HOS_DEV inline FLType particle_fraction_1D(const part_type& part, const FLType x) const
       {
         const auto prim = ParticleShape::get_shape_1D().template primitive<1>();
+        return FLType(prim(x+0.5)) - FLType(prim(x-0.5));
+      }
+      
+      template <class part_type>
+      CUDA_HOS_DEV inline FLType particle_fraction(const part_type& part, const vector_type<FLType, num_dims> &pos) const
+      {
         FLType intgral = 1;
         for (indexer i = 0; i < num_dims; ++i)
         {
-          FLType factor = FLType(prim(pos[i]+0.5)) - FLType(prim(pos[i]-0.5));
-          intgral *= factor;
+          intgral *= particle_fraction_1D(part, pos[i]);
         }
         return intgral;
       }
@@ -122,11 +128,12 @@ namespace AFFPiCS
         
         E_field_type<num_dims> ret = gather_helper<0>( particle,
                                                        [&](const vector_type<indexer, num_dims>& cell)->E_field_type<num_dims>
-                                                       { return dhis->boundary_E(cell, E_arr); },
+                                                       { return E_at(*dhis, cell, E_arr); },
                                                        [&](const indexer dim){ return dhis->E_measurement(dim); },
                                                        particle.cell(*dhis));
                                                        
-        global::log << "E " << particle.cell(*dhis) << " | " << particle.pos(*dhis) << " = " << ret << std::endl;
+        Logging::log<Logging::debug, Logging::gather>([&](auto &s)
+                                                      { s << "E " << particle.cell(*dhis) << " | " << particle.pos(*dhis) << " = " << ret; });
         
         return ret;
         
@@ -139,11 +146,138 @@ namespace AFFPiCS
         
         B_field_type<num_dims> ret = gather_helper<0>( particle,
                                                         [&](const vector_type<indexer, num_dims>& cell)->B_field_type<num_dims>
-                                                        { return dhis->boundary_B(cell, B_arr); },
+                                                        { return B_at(*dhis, cell, B_arr); },
                                                        [&](const indexer dim){ return dhis->B_measurement(dim); },
                                                        particle.cell(*dhis));
                                      
-        global::log << "B " << particle.cell(*dhis) << " | " << particle.pos(*dhis) << " = " << ret << std::endl;
+        Logging::log<Logging::debug, Logging::gather>([&](auto &s)
+                                                      { s << "B " << particle.cell(*dhis) << " | " << particle.pos(*dhis) << " = " << ret; });
+        
+        return ret;
+      }
+      
+      /*!
+        \brief Gathers both fields in a single pass over the neighbouring cells.
+        
+        \remark Since the shape is separable, the one-dimensional weights are computed
+                only once for each different measurement offset (of which there are at most two
+                per dimension in a Yee grid) and shared by all the components of both fields.
+      */
+      template <class E_arr, class B_arr, class part>
+      CUDA_HOS_DEV EB_field_type<num_dims> EB_gather(const E_arr &E_fields, const B_arr &B_fields, const part& particle) const
+      {
+        const deriv_t* dhis = static_cast<const deriv_t*>(this);
+        
+        constexpr indexer radius = compile_time_ceil(FLType(ParticleShape::get_width(0))/2) + 1;
+        constexpr indexer width = 2 * radius + 1;
+        constexpr indexer num_E = electric_field_dimensions<num_dims>();
+        constexpr indexer num_B = magnetic_field_dimensions<num_dims>();
+        
+        FLType weights[num_dims][num_E + num_B][width];
+        //The weights in each dimension for each different offset.
+        
+        FLType offsets[num_dims][num_E + num_B];
+        
+        indexer num_offsets[num_dims];
+        
+        indexer E_offsets[num_E][num_dims], B_offsets[num_B][num_dims];
+        //The offset used by each component in each dimension.
+        
+        const vector_type<FLType, num_dims> pos = particle.pos(*dhis);
+        
+        auto offset_index = [&](const indexer d, const FLType value) -> indexer
+        {
+          for (indexer o = 0; o < num_offsets[d]; ++o)
+            {
+              if (offsets[d][o] == value)
+                {
+                  return o;
+                }
+            }
+          const indexer o = num_offsets[d]++;
+          offsets[d][o] = value;
+          for (indexer k = 0; k < width; ++k)
+            {
+              weights[d][o][k] = dhis->particle_fraction_1D(particle, pos[d] - value - (k - radius));
+            }
+          return o;
+        };
+        
+        for (indexer d = 0; d < num_dims; ++d)
+          {
+            num_offsets[d] = 0;
+          }
+        
+        for (indexer i = 0; i < num_E; ++i)
+          {
+            const vector_type<FLType, num_dims> measurement = dhis->E_measurement(i);
+            for (indexer d = 0; d < num_dims; ++d)
+              {
+                E_offsets[i][d] = offset_index(d, measurement[d]);
+              }
+          }
+        
+        for (indexer i = 0; i < num_B; ++i)
+          {
+            const vector_type<FLType, num_dims> measurement = dhis->B_measurement(i);
+            for (indexer d = 0; d < num_dims; ++d)
+              {
+                B_offsets[i][d] = offset_index(d, measurement[d]);
+              }
+          }
+        
+        EB_field_type<num_dims> ret{E_field_type<num_dims>(FLType(0)), B_field_type<num_dims>(FLType(0))};
+        
+        const vector_type<indexer, num_dims> first = particle.cell(*dhis) - vector_type<indexer, num_dims>(radius);
+        
+        vector_type<indexer, num_dims> k(0);
+        
+        bool done = false;
+        
+        while (!done)
+          {
+            const vector_type<indexer, num_dims> cell = first + k;
+            
+            const E_field_type<num_dims> E_c = E_at(*dhis, cell, E_fields);
+            const B_field_type<num_dims> B_c = B_at(*dhis, cell, B_fields);
+            
+            for (indexer i = 0; i < num_E; ++i)
+              {
+                FLType factor = 1;
+                for (indexer d = 0; d < num_dims; ++d)
+                  {
+                    factor *= weights[d][E_offsets[i][d]][k[d]];
+                  }
+                ret.E[i] += E_c[i] * factor;
+              }
+            
+            for (indexer i = 0; i < num_B; ++i)
+              {
+                FLType factor = 1;
+                for (indexer d = 0; d < num_dims; ++d)
+                  {
+                    factor *= weights[d][B_offsets[i][d]][k[d]];
+                  }
+                ret.B[i] += B_c[i] * factor;
+              }
+            
+            done = true;
+            for (indexer d = 0; d < num_dims && done; ++d)
+            //Go to the next cell of the neighbourhood.
+              {
+                if (++k[d] < width)
+                  {
+                    done = false;
+                  }
+                else
+                  {
+                    k[d] = 0;
+                  }
+              }
+          }
+        
+        Logging::log<Logging::debug, Logging::gather>([&](auto &s)
+                                                      { s << "EB " << particle.cell(*dhis) << " | " << pos << " = " << ret.E << " ; " << ret.B; });
         
         return ret;
       }
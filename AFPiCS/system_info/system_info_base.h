@@ -11,6 +11,7 @@
 
 #include "../header.h"
 #include "../utilities/unit_system.h"
+#include "../utilities/ghost_cells.h"
 
 namespace AFFPiCS
 {
@@ -141,7 +142,7 @@ namespace AFFPiCS
         template <class ArrT>
         CUDA_HOS_DEV inline auto operator() (const vector_type<indexer, num_dims>& cell, const ArrT& arr) const
         {
-          return dhis->boundary_E(cell, arr);
+          return E_at(*dhis, cell, arr);
         }
       };
     
@@ -151,7 +152,7 @@ namespace AFFPiCS
         template <class ArrT>
         CUDA_HOS_DEV inline auto operator() (const vector_type<indexer, num_dims>& cell, const ArrT& arr) const
         {
-          return dhis->boundary_B(cell, arr);
+          return B_at(*dhis, cell, arr);
         }
       };
       
@@ -222,6 +223,21 @@ namespace AFFPiCS
         return B_field_type<num_dims>(0);
       }
       
+      /*!
+        \brief Gathers both the electric and the magnetic fields felt by the particle \p particle
+               in a single pass, sharing whatever depends only on its position.
+        
+        \remark Optional: when not defined, `E_gather` and `B_gather` are used separately.
+      */
+      template <class E_arr, class B_arr, class part>
+      CUDA_HOS_DEV EB_field_type<num_dims> EB_gather( const E_arr &E_fields,
+                                                      const B_arr &B_fields,
+                                                      const part& particle  ) const
+      {
+        static_assert(AFFPICS_INHERITANCE_HACK_CHECK(), "Should define this somewhere else! Blame C++ for the lack of virtual templates...");
+        return EB_field_type<num_dims>{};
+      }
+      
       /*!
         \brief Returns the dimension of the cell in relevant units.
       */
@@ -289,6 +305,21 @@ namespace AFFPiCS
         return 0;
       }
       
+      /*!
+        \brief For particles whose shape is the product of one-dimensional shapes,
+               gives the fraction of a particle that is inside a given cell along one dimension
+               when the particle has a position given by \p x (in units of cell size) in that dimension.
+        
+        \remark Only needs to be defined when the shape is separable,
+                in which case the depositers may use it to speed up the computations.
+      */
+      template <class part_type>
+      CUDA_HOS_DEV FLType particle_fraction_1D(const part_type& part, const FLType x) const
+      {
+        static_assert(AFFPICS_INHERITANCE_HACK_CHECK(), "Should define this somewhere else! Blame C++ for the lack of virtual templates...");
+        return 0;
+      }
+      
       /*!
         \brief Returns the position within the cell (in units of cell size) where the
                electric field is measured in the \p dim dimension.
@@ -431,8 +462,9 @@ namespace AFFPiCS
         
         \param force_apply If `true`, skip checks and apply boundary conditions even if inside the system.
         
-        \remark The current architecture does not easily support particle creation or destruction,
-                so absorbing boundary conditions are not easily implemented.
+        \remark Particles can be removed from the system by calling `particle_base::kill`
+                (see `AbsorbingBoundaryConditions`), which leaves them in the storage,
+                ignored by the pushers and depositers, until `particle_storage::remove_dead` is called.
       */
       template <class particle>
       CUDA_HOS_DEV void boundary_particles (particle& part, const bool force_apply = false) const
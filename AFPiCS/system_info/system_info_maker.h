@@ -188,6 +188,18 @@ template TEMPLATE PRE RET_TYPE NAME ARGUMENTS POST                    \
           AFFPICS_COMMA_TRICK(ArrT, part),
           1)
           
+      AFFPICS_SYSINFO_MAKER_TEMPLATE_FUNC(
+          AFFPICS_COMMA_TRICK(<class E_arr, class B_arr, class part>),
+          CUDA_HOS_DEV,
+          EB_field_type<num_dims>,
+          EB_gather,
+          (const E_arr &E_fields, const B_arr &B_fields, const part& particle),
+          const,
+          AFFPICS_COMMA_TRICK(E_fields, B_fields, particle),
+          AFFPICS_COMMA_TRICK(const E_arr&, const B_arr&, const part&),
+          AFFPICS_COMMA_TRICK(E_arr, B_arr, part),
+          1)
+          
       AFFPICS_SYSINFO_MAKER_FUNC(CUDA_HOS_DEV, AFFPICS_COMMA_TRICK(vector_type<FLType, num_dims>), cell_sizes, (), const, , void, 1)
       
       AFFPICS_SYSINFO_MAKER_FUNC(CUDA_HOS_DEV, bool, is_border, (const indexer i), const, i, const indexer, 1)
@@ -221,6 +233,18 @@ template TEMPLATE PRE RET_TYPE NAME ARGUMENTS POST                    \
           AFFPICS_COMMA_TRICK(const part_type&, const vector_type<FLType, num_dims>&),
           part_type,
           1)
+
+      AFFPICS_SYSINFO_MAKER_TEMPLATE_FUNC(
+          <class part_type>,
+          CUDA_HOS_DEV,
+          FLType,
+          particle_fraction_1D,
+          (const part_type& part, const FLType x),
+          const,
+          AFFPICS_COMMA_TRICK(part, x),
+          AFFPICS_COMMA_TRICK(const part_type&, const FLType),
+          part_type,
+          1)
           
       AFFPICS_SYSINFO_MAKER_FUNC(CUDA_HOS_DEV, AFFPICS_COMMA_TRICK(vector_type<FLType, num_dims>), E_measurement, (const indexer dim), const, dim, const indexer, 1)
       
@@ -346,7 +370,7 @@ private:                                                              \
 template TEMPLATE struct NAME ## EXTRAID ## _checker                  \
 {                                                                     \
   template<class T, class ... Args_> inline static constexpr          \
-  auto checker(T*) -> decltype(std::declval<T>.template NAME<TEMP_ARGS>(std::declval<Args_>()...)); \
+  auto checker(T*) -> decltype(std::declval<T>().template NAME<TEMP_ARGS>(std::declval<Args_>()...)); \
   template<class T, class ... Args_> inline static constexpr          \
   InvalidReturn checker(...);                                         \
   template <class T> inline static constexpr                          \
@@ -473,6 +497,18 @@ template TEMPLATE PRE RET_TYPE NAME ARGUMENTS POST                    \
           AFFPICS_COMMA_TRICK(ArrT, part),
           1)
           
+      AFFPICS_SYSINFO_MAKER_TEMPLATE_FUNC(
+          AFFPICS_COMMA_TRICK(<class E_arr, class B_arr, class part>),
+          CUDA_HOS_DEV,
+          EB_field_type<num_dims>,
+          EB_gather,
+          (const E_arr &E_fields, const B_arr &B_fields, const part& particle),
+          const,
+          AFFPICS_COMMA_TRICK(E_fields, B_fields, particle),
+          AFFPICS_COMMA_TRICK(const E_arr&, const B_arr&, const part&),
+          AFFPICS_COMMA_TRICK(E_arr, B_arr, part),
+          1)
+          
       AFFPICS_SYSINFO_MAKER_FUNC(CUDA_HOS_DEV, AFFPICS_COMMA_TRICK(vector_type<FLType, num_dims>), cell_sizes, (), const, , void, 1)
       
       AFFPICS_SYSINFO_MAKER_FUNC(CUDA_HOS_DEV, bool, is_border, (const indexer i), const, i, const indexer, 1)
@@ -506,6 +542,18 @@ template TEMPLATE PRE RET_TYPE NAME ARGUMENTS POST                    \
           AFFPICS_COMMA_TRICK(const part_type&, const vector_type<FLType, num_dims>&),
           part_type,
           1)
+
+      AFFPICS_SYSINFO_MAKER_TEMPLATE_FUNC(
+          <class part_type>,
+          CUDA_HOS_DEV,
+          FLType,
+          particle_fraction_1D,
+          (const part_type& part, const FLType x),
+          const,
+          AFFPICS_COMMA_TRICK(part, x),
+          AFFPICS_COMMA_TRICK(const part_type&, const FLType),
+          part_type,
+          1)
           
       AFFPICS_SYSINFO_MAKER_FUNC(CUDA_HOS_DEV, AFFPICS_COMMA_TRICK(vector_type<FLType, num_dims>), E_measurement, (const indexer dim), const, dim, const indexer, 1)
       
@@ -598,6 +646,43 @@ template TEMPLATE PRE RET_TYPE NAME ARGUMENTS POST                    \
     
     template <indexer num_dims, class end, class ... options>
     using SystemInfo = SystemInfoMaker<num_dims, end, BaseSystemInfo<num_dims, end>, options...>;
+    
+    /*!
+      \brief Is `true` if the shape of the particles of type \p part_type in a system described by \p S_Info
+             is the product of one-dimensional shapes, given by `particle_fraction_1D`.
+    */
+    template <class S_Info, class part_type, class = void>
+    struct separable_shape : std::false_type
+    {
+    };
+    
+    template <class S_Info, class part_type>
+    struct separable_shape<S_Info, part_type, std::void_t<decltype(S_Info::template has_particle_fraction_1D1<part_type>)>> :
+    std::bool_constant<S_Info::template has_particle_fraction_1D1<part_type>>
+    {
+    };
+    
+    template <class S_Info, class part_type>
+    inline constexpr bool separable_shape_v = separable_shape<S_Info, part_type>::value;
+    
+    /*!
+      \brief Is `true` if a system described by \p S_Info can gather both fields
+             felt by a particle of type \p part_type in a single pass through `EB_gather`.
+    */
+    template <class S_Info, class E_arr, class B_arr, class part_type, class = void>
+    struct combined_gather : std::false_type
+    {
+    };
+    
+    template <class S_Info, class E_arr, class B_arr, class part_type>
+    struct combined_gather<S_Info, E_arr, B_arr, part_type,
+                           std::void_t<decltype(S_Info::template has_EB_gather1<E_arr, B_arr, part_type>)>> :
+    std::bool_constant<S_Info::template has_EB_gather1<E_arr, B_arr, part_type>>
+    {
+    };
+    
+    template <class S_Info, class E_arr, class B_arr, class part_type>
+    inline constexpr bool combined_gather_v = combined_gather<S_Info, E_arr, B_arr, part_type>::value;
   }
 }
 
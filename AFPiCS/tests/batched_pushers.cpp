@@ -0,0 +1,299 @@
+/*!
+  \file batched_pushers.cpp
+  
+  \brief Checks that the batched versions of the Boris, Vay and Higuera-Cary pushers
+         give the same momenta as the single particle ones,
+         both for the momentum update on its own and when pushing a species
+         stored as a structure of arrays through `Pushers::SimplePusher`.
+         Returns the number of checks that failed.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../everything.h"
+#include <iostream>
+#include <random>
+#include <limits>
+#include <algorithm>
+
+using namespace AFFPiCS;
+
+using parallelism = g24_lib::Parallelism::OpenMP;
+
+constexpr FLType tolerance = 64 * std::numeric_limits<FLType>::epsilon();
+
+/*!
+  \brief Returns the largest difference between the momenta given by `updated_u`
+         of \p pusher_functor for a batch of \p W particles and for each of those particles on its own,
+         relative to the size of the momenta (or absolute, for momenta smaller than 1).
+*/
+template <class pusher_functor, indexer num_dims, indexer W = SIMD::native_width<FLType>>
+FLType batch_mismatch(const vector_type<FLType, num_dims> (&u)[W],
+                      const E_field_type<num_dims> (&E)[W],
+                      const B_field_type<num_dims> (&B)[W],
+                      const FLType q_dt_m_factor, const FLType c)
+{
+  using namespace std;
+  
+  SIMD::vec<num_dims, W> u_b;
+  SIMD::vec<electric_field_dimensions<num_dims>(), W> E_b;
+  SIMD::vec<magnetic_field_dimensions<num_dims>(), W> B_b;
+  
+  for (indexer l = 0; l < W; ++l)
+    {
+      u_b.set_lane(l, u[l]);
+      E_b.set_lane(l, E[l]);
+      B_b.set_lane(l, B[l]);
+    }
+  
+  const SIMD::vec<num_dims, W> new_u_b = pusher_functor::updated_u(u_b, E_b, B_b, q_dt_m_factor, c);
+  
+  FLType ret = 0;
+  
+  for (indexer l = 0; l < W; ++l)
+    {
+      const vector_type<FLType, num_dims> new_u = pusher_functor::updated_u(u[l], E[l], B[l], q_dt_m_factor, c);
+      const FLType scale = max(FLType(1), sqrt(new_u.square_norm2()));
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          ret = max(ret, FLType(abs(new_u_b[d].lane(l) - new_u[d]) / scale));
+        }
+    }
+  
+  return ret;
+}
+
+template <class pusher_functor, indexer num_dims>
+bool check_updated_u(const char * name, std::mt19937_64 &gen)
+{
+  constexpr indexer W = SIMD::native_width<FLType>;
+  
+  constexpr indexer trials = 1000;
+  
+  const FLType c = 1;
+  
+  std::uniform_real_distribution<double> dist(-10, 10);
+  
+  FLType worst = 0;
+  
+  for (indexer t = 0; t < trials; ++t)
+    {
+      vector_type<FLType, num_dims> u[W];
+      E_field_type<num_dims> E[W];
+      B_field_type<num_dims> B[W];
+      for (indexer l = 0; l < W; ++l)
+        {
+          for (indexer d = 0; d < num_dims; ++d)
+            {
+              u[l][d] = dist(gen);
+            }
+          for (indexer d = 0; d < electric_field_dimensions<num_dims>(); ++d)
+            {
+              E[l][d] = dist(gen);
+            }
+          for (indexer d = 0; d < magnetic_field_dimensions<num_dims>(); ++d)
+            {
+              B[l][d] = dist(gen);
+            }
+        }
+      const FLType q_dt_m_factor = dist(gen) / 20;
+      worst = std::max(worst, batch_mismatch<pusher_functor, num_dims, W>(u, E, B, q_dt_m_factor, c));
+    }
+  
+  const bool ok = worst <= tolerance;
+  
+  std::cout << name << " updated_u (" << num_dims << "D): " << (ok ? "ok" : "MISMATCH") << " (" << worst << ")" << std::endl;
+  
+  return ok;
+}
+
+template <indexer num_dims>
+class test_particle : public Particles::particle_simple<num_dims, test_particle<num_dims>>
+{
+  public:
+  
+  using Particles::particle_simple<num_dims, test_particle<num_dims>>::particle_simple;
+  //Inherit constructors.
+  
+  template <class system_info>
+  CUDA_HOS_DEV FLType mass(const system_info &info) const
+  {
+    return FLType(1);
+  }
+  
+  template <class system_info>
+  CUDA_HOS_DEV FLType charge(const system_info &info) const
+  {
+    return FLType(-1);
+  }
+};
+
+template <indexer num_dims>
+using test_soa_particle = typename Particles::StructureOfArrays<test_particle>::template type<num_dims>;
+
+template <indexer num_dims>
+struct test_system;
+
+template <indexer num_dims>
+using test_system_base = SystemDefinitions::SystemInfo< num_dims, test_system<num_dims>,
+                                                        SystemDefinitions::SystemInfoConstant<num_dims, test_system<num_dims>>,
+                                                        SystemDefinitions::PeriodicBoundaryConditions<num_dims, test_system<num_dims>>,
+                                                        SystemDefinitions::YeeMethodGrid<num_dims, test_system<num_dims>>,
+                                                        SystemDefinitions::SymbolicShapeSimpler<num_dims, ParticleShapes::Spline<num_dims, 1>,
+                                                                                                test_system<num_dims>> >;
+
+template <indexer num_dims>
+struct test_system : public test_system_base<num_dims>
+{
+  using base_t = test_system_base<num_dims>;
+  using base_t::base_t;
+};
+
+/*!
+  \brief Pushes the same particles (of a species stored as a structure of arrays)
+         with the batched and the single particle versions of \p pusher_functor
+         through `Pushers::SimplePusher` and compares the resulting momenta.
+         The number of particles is not a multiple of the batch size
+         and some of the particles are dead, which must be left unchanged.
+*/
+template <class pusher_functor, indexer num_dims>
+bool check_simple_pusher(const char * name, std::mt19937_64 &gen)
+{
+  using system_info = test_system<num_dims>;
+  
+  using single = Pushers::SimplePusher<pusher_functor, system_info, num_dims, test_soa_particle>;
+  using batched = Pushers::SimplePusher<PusherFunctors::Batched<pusher_functor>, system_info, num_dims, test_soa_particle>;
+  
+  using particle = test_soa_particle<num_dims>;
+  
+  constexpr indexer W = SIMD::native_width<FLType>;
+  
+  constexpr indexer num_cells = 8;
+  
+  const indexer num_parts = 5 * W + W / 2 + 1;
+  
+  const FLType dt = 0.1;
+  
+  const system_info info(vector_type<indexer, num_dims>(num_cells), vector_type<FLType, num_dims>(FLType(1)));
+  
+  std::uniform_real_distribution<double> dist(-10, 10), unit(0, 1);
+  std::uniform_int_distribution<indexer> cell_dist(0, num_cells - 1);
+  
+  E_field_holder<parallelism, num_dims> E_fields(info.total_cells());
+  B_field_holder<parallelism, num_dims> B_fields(info.total_cells());
+  
+  for (indexer i = 0; i < info.total_cells(); ++i)
+    {
+      E_field_type<num_dims> E;
+      B_field_type<num_dims> B;
+      for (indexer d = 0; d < E.size(); ++d)
+        {
+          E[d] = dist(gen);
+        }
+      for (indexer d = 0; d < B.size(); ++d)
+        {
+          B[d] = dist(gen);
+        }
+      E_fields[i] = E;
+      B_fields[i] = B;
+    }
+  
+  update_E_ghosts(E_fields, info);
+  update_B_ghosts(B_fields, info);
+  
+  particle_storage<parallelism, particle> single_parts;
+  
+  auto &parts = single_parts.template get_particles<particle>();
+  
+  parts.resize(num_parts);
+  
+  for (indexer i = 0; i < num_parts; ++i)
+    {
+      vector_type<indexer, num_dims> cell;
+      vector_type<FLType, num_dims> pos, u;
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          cell[d] = cell_dist(gen);
+          pos[d] = unit(gen);
+          u[d] = dist(gen);
+        }
+      particle part(cell, pos);
+      part.set_u(u, info);
+      if (i % 7 == 3)
+        {
+          part.kill(info);
+        }
+      parts[i] = part;
+    }
+  
+  particle_storage<parallelism, particle> batched_parts = single_parts;
+  
+  const particle_storage<parallelism, particle> original = single_parts;
+  
+  typename single::template storage<parallelism> single_store;
+  typename batched::template storage<parallelism> batched_store;
+  
+  single_store.initialize(single_parts, E_fields, B_fields, info);
+  batched_store.initialize(batched_parts, E_fields, B_fields, info);
+  
+  single::template push<parallelism>(single_store, single_parts, E_fields, B_fields, dt, info);
+  batched::template push<parallelism>(batched_store, batched_parts, E_fields, B_fields, dt, info);
+  
+  const auto &before = original.template get_particles<particle>();
+  const auto &after_single = single_parts.template get_particles<particle>();
+  const auto &after_batched = batched_parts.template get_particles<particle>();
+  
+  FLType worst = 0;
+  
+  bool dead_unchanged = true;
+  
+  for (indexer i = 0; i < num_parts; ++i)
+    {
+      const particle p_b = after_batched[i], p_s = after_single[i], p_0 = before[i];
+      const vector_type<FLType, num_dims> u_b = p_b.u(info), u_s = p_s.u(info);
+      const FLType scale = std::max(FLType(1), std::sqrt(u_s.square_norm2()));
+      if (!p_0.is_alive(info))
+        {
+          dead_unchanged = ( dead_unchanged && !p_b.is_alive(info) &&
+                             std::sqrt((u_b - p_0.u(info)).square_norm2()) <= tolerance * scale );
+          continue;
+        }
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          worst = std::max(worst, FLType(std::abs(u_b[d] - u_s[d]) / scale));
+        }
+    }
+  
+  const bool ok = worst <= tolerance && dead_unchanged;
+  
+  std::cout << name << " SimplePusher (" << num_dims << "D, " << num_parts << " particles): "
+            << (ok ? "ok" : "MISMATCH") << " (" << worst << (dead_unchanged ? "" : ", dead particles changed") << ")" << std::endl;
+  
+  return ok;
+}
+
+template <class pusher_functor>
+indexer check_all_dimensions(const char * name, std::mt19937_64 &gen)
+{
+  indexer failures = 0;
+  failures += !check_updated_u<pusher_functor, 1>(name, gen);
+  failures += !check_updated_u<pusher_functor, 2>(name, gen);
+  failures += !check_updated_u<pusher_functor, 3>(name, gen);
+  failures += !check_simple_pusher<pusher_functor, 1>(name, gen);
+  failures += !check_simple_pusher<pusher_functor, 2>(name, gen);
+  failures += !check_simple_pusher<pusher_functor, 3>(name, gen);
+  return failures;
+}
+
+int main()
+{
+  std::mt19937_64 gen(24);
+  
+  indexer failures = 0;
+  
+  failures += check_all_dimensions<PusherFunctors::Boris>("Boris", gen);
+  failures += check_all_dimensions<PusherFunctors::Vay>("Vay", gen);
+  failures += check_all_dimensions<PusherFunctors::HigueraCary>("Higuera-Cary", gen);
+  
+  return int(failures);
+}
@@ -0,0 +1,191 @@
+/*!
+  \file population_control.cpp
+  
+  \brief Checks that splitting particles with `PopulationControl::controller`
+         brings the cells to the target number of particles, conserves the weight in each cell
+         and divides it evenly when the target is the original number times a power of two.
+         Returns the number of checks that failed.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../everything.h"
+#include <iostream>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include <vector>
+
+using namespace AFFPiCS;
+
+using parallelism = g24_lib::Parallelism::OpenMP;
+
+constexpr FLType tolerance = 64 * std::numeric_limits<FLType>::epsilon();
+
+template <indexer num_dims>
+class test_particle : public Particles::particle_weighted<num_dims, test_particle<num_dims>>
+{
+  public:
+  
+  using Particles::particle_weighted<num_dims, test_particle<num_dims>>::particle_weighted;
+  //Inherit constructors.
+  
+  template <class system_info>
+  CUDA_HOS_DEV FLType mass(const system_info &info) const
+  {
+    return FLType(1);
+  }
+  
+  template <class system_info>
+  CUDA_HOS_DEV FLType charge(const system_info &info) const
+  {
+    return FLType(-1);
+  }
+};
+
+template <indexer num_dims>
+struct test_system;
+
+template <indexer num_dims>
+using test_system_base = SystemDefinitions::SystemInfo< num_dims, test_system<num_dims>,
+                                                        SystemDefinitions::SystemInfoConstant<num_dims, test_system<num_dims>>,
+                                                        SystemDefinitions::PeriodicBoundaryConditions<num_dims, test_system<num_dims>>,
+                                                        SystemDefinitions::YeeMethodGrid<num_dims, test_system<num_dims>>,
+                                                        SystemDefinitions::SymbolicShapeSimpler<num_dims, ParticleShapes::Spline<num_dims, 1>,
+                                                                                                test_system<num_dims>> >;
+
+template <indexer num_dims>
+struct test_system : public test_system_base<num_dims>
+{
+  using base_t = test_system_base<num_dims>;
+  using base_t::base_t;
+};
+
+/*!
+  \brief Fills the first cells of a system with 3, 5 and 12 particles of random weights
+         (the same in each cell, leaving the rest of the cells empty)
+         and splits them towards 12 particles per cell.
+         The first cell (12 = 3 * 4) must end up with all the weights equal,
+         the second one (whose last round only splits some of the particles)
+         within a factor of two, and the third one must be left unchanged.
+*/
+template <indexer num_dims>
+bool check_split(std::mt19937_64 &gen)
+{
+  using system_info = test_system<num_dims>;
+  
+  using particle = test_particle<num_dims>;
+  
+  constexpr indexer num_cells = 4;
+  
+  const system_info info(vector_type<indexer, num_dims>(num_cells), vector_type<FLType, num_dims>(FLType(1)));
+  
+  const indexer total_cells = info.total_cells();
+  
+  const indexer initial[3] = {3, 5, 12};
+  
+  PopulationControl::band b;
+  b.min_ppc = 8;
+  b.target_ppc = 12;
+  b.max_ppc = 100;
+  
+  std::uniform_real_distribution<double> dist(-1, 1), unit(0, 1), weight_dist(0.5, 2);
+  
+  particle_storage<parallelism, particle> storage;
+  
+  auto &parts = storage.template get_particles<particle>();
+  
+  parts.resize(initial[0] + initial[1] + initial[2]);
+  
+  std::vector<FLType> weight_before(total_cells, FLType(0));
+  
+  indexer n = 0;
+  
+  for (indexer c = 0; c < 3; ++c)
+    {
+      vector_type<indexer, num_dims> cell(0);
+      cell[0] = c;
+      const FLType w = weight_dist(gen);
+      for (indexer k = 0; k < initial[c]; ++k, ++n)
+        {
+          vector_type<FLType, num_dims> pos, u;
+          for (indexer d = 0; d < num_dims; ++d)
+            {
+              pos[d] = unit(gen);
+              u[d] = dist(gen);
+            }
+          particle part(cell, pos);
+          part.set_u(u, info);
+          part.set_weight(w, info);
+          parts[n] = part;
+          weight_before[info.to_index(cell)] += w;
+        }
+    }
+  
+  PopulationControl::controller<parallelism> controller;
+  
+  controller.apply(storage, b, info);
+  
+  const auto &after = storage.template get_particles<particle>();
+  
+  std::vector<FLType> weight_after(total_cells, FLType(0)),
+                      w_min(total_cells, std::numeric_limits<FLType>::max()),
+                      w_max(total_cells, FLType(0));
+  std::vector<indexer> count(total_cells, 0);
+  
+  for (indexer i = 0; i < after.size(); ++i)
+    {
+      const particle p = after[i];
+      if (!p.is_alive(info))
+        {
+          continue;
+        }
+      const indexer c = info.to_index(p.cell(info));
+      const FLType w = p.weight(info);
+      weight_after[c] += w;
+      w_min[c] = std::min(w_min[c], w);
+      w_max[c] = std::max(w_max[c], w);
+      ++count[c];
+    }
+  
+  bool ok = true;
+  
+  FLType worst_weight = 0;
+  
+  for (indexer c = 0; c < total_cells; ++c)
+    {
+      worst_weight = std::max(worst_weight, FLType(std::abs(weight_after[c] - weight_before[c]) / std::max(FLType(1), weight_before[c])));
+      ok = ok && count[c] == (weight_before[c] > 0 ? b.target_ppc : 0);
+    }
+  
+  vector_type<indexer, num_dims> cell(0);
+  
+  const indexer c_even = info.to_index(cell);
+  const indexer c_uneven = info.to_index(cell.add(0, 1));
+  const indexer c_full = info.to_index(cell.add(0, 2));
+  
+  const FLType ratio_even = w_max[c_even] / w_min[c_even];
+  const FLType ratio_uneven = w_max[c_uneven] / w_min[c_uneven];
+  const FLType ratio_full = w_max[c_full] / w_min[c_full];
+  
+  ok = ( ok && worst_weight <= tolerance &&
+         ratio_even <= 1 + tolerance && ratio_uneven <= 2 + tolerance && ratio_full <= 1 + tolerance );
+  
+  std::cout << "Split (" << num_dims << "D): " << (ok ? "ok" : "MISMATCH")
+            << " (weight " << worst_weight << ", ratios " << ratio_even << " " << ratio_uneven << " " << ratio_full << ")" << std::endl;
+  
+  return ok;
+}
+
+int main()
+{
+  std::mt19937_64 gen(24);
+  
+  indexer failures = 0;
+  
+  failures += !check_split<1>(gen);
+  failures += !check_split<2>(gen);
+  failures += !check_split<3>(gen);
+  
+  return int(failures);
+}
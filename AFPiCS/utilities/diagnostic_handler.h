@@ -40,6 +40,10 @@ namespace AFFPiCS
     G24_LIB_FUNC_CHECKER(after_depositer);
     G24_LIB_FUNC_CHECKER(after_mover);
     
+    G24_LIB_FUNC_CHECKER(synchronized_step);
+    
+    G24_LIB_FUNC_CHECKER(inject);
+    
     public:
     
     static constexpr bool pre_step = pre_step_f_exists<diagnostic>;
@@ -55,6 +59,13 @@ namespace AFFPiCS
     static constexpr bool after_depositer = after_depositer_f_exists<diagnostic>;
     static constexpr bool after_mover = after_mover_f_exists<diagnostic>;
     
+    static constexpr bool synchronized_step = synchronized_step_f_exists<diagnostic>;
+    //Whether the diagnostics tell on which steps they need the particles
+    //to be synchronized with the fields (see `Simulation::set_merged_moves`).
+    
+    static constexpr bool inject = inject_f_exists<diagnostic>;
+    //Whether the diagnostics add particles to the system (see `Simulation::simulate_once`).
+    
     
   };
 }
@@ -0,0 +1,503 @@
+#ifndef AFFPICS_GHOST_CELLS_HOLDER
+#define AFFPICS_GHOST_CELLS_HOLDER
+
+/*!
+  \file ghost_cells.h
+  
+  \brief Storage of fields and currents surrounded by a layer of ghost cells
+         holding the values given by the boundary conditions,
+         so that the neighbours of any cell can be accessed directly.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include "planar_fields.h"
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+
+namespace AFFPiCS
+{
+  /*!
+    \brief Stores the values of a field (in an \p inner holder) over the cells of the system
+           and over a layer of ghost cells around it.
+    
+    \remark Indexing with the usual linear indices of the system gives the values
+            at the corresponding cells, so everything else works as usual,
+            while `at(cell)` gives the value at any cell up to `ghost_width()` cells
+            outside of the system without going through the boundary conditions.
+            The ghost cells must have been filled with `fill_ghosts`
+            (usually through `update_E_ghosts` and the like) after the last change to the fields.
+    
+    \remark Until `set_geometry` is called, the values are stored without any ghost cells
+            and `at` must not be used.
+  */
+  template <class parallelism, class inner, indexer num_dims>
+  class ghost_field_holder
+  {
+    public:
+    
+    using value_type = std::decay_t<decltype(std::declval<const inner &>()[0])>;
+    
+    static constexpr bool ghost_layer = true;
+    
+    private:
+    
+    inner data;
+    
+    indexer num;
+    //The number of cells of the system.
+    
+    bool ghosted;
+    
+    indexer width;
+    
+    vector_type<indexer, num_dims> cells, strides, padded_strides;
+    //The strides of the linear indices of the system and of the padded storage.
+    
+    indexer order[num_dims];
+    //The dimensions, by decreasing stride.
+    
+    indexer origin;
+    //The index in the padded storage of the first cell of the system.
+    
+    g24_lib::array_parallel<parallelism, indexer> ghost_ids;
+    //The indices in the padded storage of all the ghost cells.
+    
+    indexer row_length;
+    //The number of cells along the dimension with unit stride.
+    
+    g24_lib::array_parallel<parallelism, indexer> row_offsets;
+    //What must be added to the linear index of any cell of each row
+    //(the cells that only differ along the dimension with unit stride)
+    //to give its index in the padded storage.
+    
+    CUDA_HOS_DEV vector_type<indexer, num_dims> decompose(indexer idx, const vector_type<indexer, num_dims> &strds) const
+    {
+      vector_type<indexer, num_dims> ret;
+      for (indexer k = 0; k + 1 < num_dims; ++k)
+        {
+          const indexer d = order[k];
+          ret[d] = idx / strds[d];
+          idx -= ret[d] * strds[d];
+        }
+      ret[order[num_dims - 1]] = idx;
+      //The innermost stride is always one.
+      return ret;
+    }
+    
+    CUDA_HOS_DEV indexer padded_index(const vector_type<indexer, num_dims> &cell) const
+    {
+      indexer ret = origin;
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          ret += cell[d] * padded_strides[d];
+        }
+      return ret;
+    }
+    
+    CUDA_HOS_DEV indexer padded_index(const indexer idx) const
+    {
+      return (ghosted ? idx + row_offsets[idx / row_length] : idx);
+      //Since the rows are contiguous in both layouts,
+      //this costs a single division instead of one per dimension.
+    }
+    
+    template <class Getter>
+    struct fill_functor
+    {
+      template <class IdArr, class ... Args>
+      CUDA_HOS_DEV void operator() (const IdArr &ids, const indexer k, ghost_field_holder &holder, const Args& ... args) const
+      {
+        const vector_type<indexer, num_dims> cell = holder.decompose(ids[k], holder.padded_strides) -
+                                                    vector_type<indexer, num_dims>(holder.width);
+        holder.data[ids[k]] = Getter{}(cell, static_cast<const ghost_field_holder &>(holder), args...);
+      }
+    };
+    
+    public:
+    
+    ghost_field_holder(const indexer n = 0): data(n), num(n), ghosted(false), width(0),
+    cells(0), strides(0), padded_strides(0), origin(0), row_length(1)
+    {
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          order[d] = d;
+        }
+    }
+    
+    CUDA_HOS_DEV indexer size() const
+    {
+      return num;
+    }
+    
+    CUDA_HOS_DEV indexer ghost_width() const
+    {
+      return (ghosted ? width : 0);
+    }
+    
+    /*!
+      \brief Changes the number of cells, discarding the ghost cells
+             unless the number is the same.
+    */
+    void resize(const indexer n)
+    {
+      if (n != num || !ghosted)
+        {
+          ghosted = false;
+          data.resize(n);
+          num = n;
+        }
+    }
+    
+    /*!
+      \brief Returns `true` if the ghost cells are laid out for the system described by \p info
+             with a width of \p w.
+    */
+    template <class S_Info>
+    bool has_geometry(const S_Info &info, const indexer w = Defaults::ghost_cells) const
+    {
+      if (!ghosted || width != w)
+        {
+          return false;
+        }
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          if (cells[d] != info.num_cells(d))
+            {
+              return false;
+            }
+        }
+      return true;
+    }
+    
+    /*!
+      \brief Rearranges the storage so there are \p w ghost cells at each side
+             of the system described by \p info in every dimension,
+             keeping the values at the cells of the system.
+      
+      \pre The linear cell indices given by \p info must be affine in the cells
+           (as with any row- or column-major ordering).
+    */
+    template <class S_Info>
+    void set_geometry(const S_Info &info, const indexer w = Defaults::ghost_cells)
+    {
+      using namespace std;
+      
+      inner old_values(num);
+      
+      for (indexer i = 0; i < num; ++i)
+        {
+          old_values[i] = static_cast<const ghost_field_holder &>(*this)[i];
+        }
+      
+      const vector_type<indexer, num_dims> zero(0);
+      
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          strides[d] = info.to_index(zero.add(d, 1)) - info.to_index(zero);
+          cells[d] = info.num_cells(d);
+          order[d] = d;
+        }
+      
+      sort(order, order + num_dims, [&](const indexer a, const indexer b){ return strides[a] > strides[b]; });
+      
+      width = w;
+      
+      padded_strides[order[num_dims - 1]] = 1;
+      
+      for (indexer k = num_dims - 1; k > 0; --k)
+        {
+          padded_strides[order[k - 1]] = padded_strides[order[k]] * (cells[order[k]] + 2 * width);
+        }
+      
+      origin = 0;
+      
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          origin += width * padded_strides[d];
+        }
+      
+      const indexer padded_total = padded_strides[order[0]] * (cells[order[0]] + 2 * width);
+      
+      data.resize(padded_total);
+      
+      const indexer old_num = num;
+      
+      num = cells.multiply_all();
+      
+      row_length = cells[order[num_dims - 1]];
+      
+      row_offsets.resize(num / row_length);
+      
+      for (indexer r = 0; r < row_offsets.size(); ++r)
+        {
+          row_offsets[r] = padded_index(decompose(r * row_length, strides)) - r * row_length;
+        }
+      
+      ghosted = true;
+      
+      for (indexer i = 0; i < num; ++i)
+        {
+          (*this)[i] = (i < old_num ? value_type(old_values[i]) : value_type(FLType(0)));
+        }
+      
+      std::vector<indexer> ids;
+      
+      for (indexer p = 0; p < padded_total; ++p)
+        {
+          const vector_type<indexer, num_dims> cell = decompose(p, padded_strides);
+          bool ghost = false;
+          for (indexer d = 0; d < num_dims; ++d)
+            {
+              ghost = ghost || cell[d] < width || cell[d] >= cells[d] + width;
+            }
+          if (ghost)
+            {
+              ids.push_back(p);
+            }
+        }
+      
+      ghost_ids.resize(ids.size());
+      
+      for (indexer k = 0; k < ghost_ids.size(); ++k)
+        {
+          ghost_ids[k] = ids[k];
+        }
+    }
+    
+    /*!
+      \brief Sets every ghost cell to `Getter{}(cell, *this, args...)`,
+             where `cell` is the (outside) cell and `*this` can be used
+             to access the values at the cells of the system.
+    */
+    template <class Getter, class ... Args>
+    void fill_ghosts(const Args& ... args)
+    {
+      parallelism::loop(ghost_ids, fill_functor<Getter>{}, *this, args...);
+    }
+    
+    CUDA_HOS_DEV decltype(auto) operator[] (const indexer i)
+    {
+      return data[padded_index(i)];
+    }
+    
+    CUDA_HOS_DEV decltype(auto) operator[] (const indexer i) const
+    {
+      return data[padded_index(i)];
+    }
+    
+    /*!
+      \brief The value at \p cell, which may be up to `ghost_width()` cells outside of the system.
+    */
+    CUDA_HOS_DEV decltype(auto) at(const vector_type<indexer, num_dims> &cell) const
+    {
+      assert(ghosted);
+      return data[padded_index(cell)];
+    }
+    
+    private:
+    
+    inner interior() const
+    {
+      inner ret(num);
+      for (indexer i = 0; i < num; ++i)
+        {
+          ret[i] = (*this)[i];
+        }
+      return ret;
+    }
+    
+    void from_interior(const inner &arr)
+    {
+      data = arr;
+      num = arr.size();
+      ghosted = false;
+    }
+    
+    public:
+    
+    template<class stream, class str = std::basic_string<typename stream::char_type>>
+    CUDA_ONLY_HOS void textual_output(stream &s, const str& separator = " ") const
+    {
+      interior().textual_output(s, separator);
+    }
+    
+    template<class stream>
+    CUDA_ONLY_HOS void binary_output(stream &s) const
+    {
+      interior().binary_output(s);
+    }
+    
+    template<class stream>
+    CUDA_ONLY_HOS void textual_input(stream &s)
+    {
+      inner temp;
+      temp.textual_input(s);
+      from_interior(temp);
+    }
+    
+    template<class stream>
+    CUDA_ONLY_HOS void binary_input(stream &s)
+    {
+      inner temp;
+      temp.binary_input(s);
+      from_interior(temp);
+    }
+  };
+  
+  template <class T, class = void>
+  struct has_ghost_cells : std::false_type {};
+  
+  template <class T>
+  struct has_ghost_cells<T, std::void_t<decltype(T::ghost_layer)>> :
+  std::bool_constant<T::ghost_layer> {};
+  
+  /*!
+    \brief Throws if something that reads up to \p reach cells away from the system
+           would go past the ghost cells of an \p ArrT.
+           Does nothing if \p ArrT has no ghost cells.
+  */
+  template <class ArrT>
+  inline void check_ghost_reach(const indexer reach)
+  {
+    if constexpr (has_ghost_cells<ArrT>::value)
+      {
+        if (reach > Defaults::ghost_cells)
+          {
+            throw std::invalid_argument("The particle shapes reach past the ghost cells: increase Defaults::ghost_cells.");
+          }
+      }
+  }
+  
+  namespace GhostCells
+  {
+    struct E_getter
+    {
+      template <class Cell, class ArrT, class S_Info>
+      CUDA_HOS_DEV auto operator() (const Cell &cell, const ArrT &arr, const S_Info &info) const
+      {
+        return info.boundary_E(cell, arr);
+      }
+    };
+    
+    struct B_getter
+    {
+      template <class Cell, class ArrT, class S_Info>
+      CUDA_HOS_DEV auto operator() (const Cell &cell, const ArrT &arr, const S_Info &info) const
+      {
+        return info.boundary_B(cell, arr);
+      }
+    };
+    
+    struct J_getter
+    {
+      template <class Cell, class ArrT, class S_Info>
+      CUDA_HOS_DEV auto operator() (const Cell &cell, const ArrT &arr, const S_Info &info) const
+      {
+        return info.boundary_J(cell, arr);
+      }
+    };
+    
+    template <class Getter, class ArrT, class S_Info>
+    void update(ArrT &arr, const S_Info &info)
+    {
+      if constexpr (has_ghost_cells<ArrT>::value)
+        {
+          if (!arr.has_geometry(info))
+            {
+              arr.set_geometry(info);
+            }
+          arr.template fill_ghosts<Getter>(info);
+        }
+    }
+  }
+  
+  /*!
+    \brief Fills the ghost cells of \p E_fields according to the boundary conditions of \p info,
+           laying them out first if needed.
+           Does nothing if the fields are not stored with ghost cells.
+  */
+  template <class ArrT, class S_Info>
+  void update_E_ghosts(ArrT &E_fields, const S_Info &info)
+  {
+    GhostCells::update<GhostCells::E_getter>(E_fields, info);
+  }
+  
+  /*!
+    \brief Fills the ghost cells of \p B_fields according to the boundary conditions of \p info,
+           laying them out first if needed.
+           Does nothing if the fields are not stored with ghost cells.
+  */
+  template <class ArrT, class S_Info>
+  void update_B_ghosts(ArrT &B_fields, const S_Info &info)
+  {
+    GhostCells::update<GhostCells::B_getter>(B_fields, info);
+  }
+  
+  /*!
+    \brief Fills the ghost cells of \p currents according to the boundary conditions of \p info,
+           laying them out first if needed.
+           Does nothing if the currents are not stored with ghost cells.
+  */
+  template <class ArrT, class S_Info>
+  void update_J_ghosts(ArrT &currents, const S_Info &info)
+  {
+    GhostCells::update<GhostCells::J_getter>(currents, info);
+  }
+  
+  /*!
+    \brief The electric field at \p cell, read directly if \p E_fields has ghost cells
+           and through `info.boundary_E` otherwise.
+  */
+  template <class S_Info, class ArrT, indexer num_dims>
+  CUDA_HOS_DEV inline E_field_type<num_dims> E_at(const S_Info &info, const vector_type<indexer, num_dims> &cell, const ArrT &E_fields)
+  {
+    if constexpr (has_ghost_cells<ArrT>::value)
+      {
+        return E_fields.at(cell);
+      }
+    else
+      {
+        return info.boundary_E(cell, E_fields);
+      }
+  }
+  
+  /*!
+    \brief The magnetic field at \p cell, read directly if \p B_fields has ghost cells
+           and through `info.boundary_B` otherwise.
+  */
+  template <class S_Info, class ArrT, indexer num_dims>
+  CUDA_HOS_DEV inline B_field_type<num_dims> B_at(const S_Info &info, const vector_type<indexer, num_dims> &cell, const ArrT &B_fields)
+  {
+    if constexpr (has_ghost_cells<ArrT>::value)
+      {
+        return B_fields.at(cell);
+      }
+    else
+      {
+        return info.boundary_B(cell, B_fields);
+      }
+  }
+  
+  /*!
+    \brief The current at \p cell, read directly if \p currents has ghost cells
+           and through `info.boundary_J` otherwise.
+  */
+  template <class S_Info, class ArrT, indexer num_dims>
+  CUDA_HOS_DEV inline current_type<num_dims> J_at(const S_Info &info, const vector_type<indexer, num_dims> &cell, const ArrT &currents)
+  {
+    if constexpr (has_ghost_cells<ArrT>::value)
+      {
+        return currents.at(cell);
+      }
+    else
+      {
+        return info.boundary_J(cell, currents);
+      }
+  }
+}
+
+#endif
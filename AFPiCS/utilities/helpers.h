@@ -49,11 +49,17 @@ namespace AFFPiCS
       }
   }
   
-  template <indexer dim_out, indexer num_dims, class ArrT, class BoundFunc>
-  inline vector_type<FLType, dim_out> curl( const vector_type<indexer, num_dims>& cell,
-                                            const ArrT& arr,
-                                            const BoundFunc & f,
-                                            const vector_type<FLType, num_dims>& cell_size )
+  /*!
+    \brief Computes the curl of a field (with centered differences)
+           given a way to get its values at the neighbouring cells.
+    
+    \param f Is called as `f(dim, sign)` and returns the field at the cell
+             that is one cell away from the one where the curl is being computed
+             in the dimension `dim`, in the direction given by `sign` (either -1 or 1).
+  */
+  template <indexer dim_out, indexer num_dims, class NeighbourFunc>
+  inline vector_type<FLType, dim_out> curl_from_neighbours( const NeighbourFunc & f,
+                                                            const vector_type<FLType, num_dims>& cell_size )
   {
     if constexpr (num_dims == 1)
       {
@@ -73,10 +79,10 @@ namespace AFFPiCS
             //(rot F)_z = d F_y / dx - d F_x / dy
             
             //d F_y / dx
-            ret[0] += (f(cell.add(0,1), arr)[1]-f(cell.subtract(0,1), arr)[1])/cell_size[0];
+            ret[0] += (f(0, 1)[1]-f(0, -1)[1])/cell_size[0];
             
             //- d E_x / dy
-            ret[0] -= (f(cell.add(1,1), arr)[0]-f(cell.subtract(1,1), arr)[0])/cell_size[1];
+            ret[0] -= (f(1, 1)[0]-f(1, -1)[0])/cell_size[1];
             
             return ret/2;
           }
@@ -88,10 +94,10 @@ namespace AFFPiCS
             vector_type<FLType, dim_out> ret;
             
             //(rot F)_x = d F_z / dy
-            ret[0] = (f(cell.add(1,1), arr)[0]-f(cell.subtract(1,1), arr)[0])/cell_size[1];
+            ret[0] = (f(1, 1)[0]-f(1, -1)[0])/cell_size[1];
               
             //(rot F)_y = -d F_z / dx
-            ret[1] = -(f(cell.add(0,1), arr)[0]-f(cell.subtract(0,1), arr)[0])/cell_size[0];
+            ret[1] = -(f(0, 1)[0]-f(0, -1)[0])/cell_size[0];
             
             return ret/2;
           }
@@ -102,14 +108,14 @@ namespace AFFPiCS
         vector_type<FLType, dim_out> ret{0,0,0};
         
         //(rot F)_x = d F_z / dy - d F_y / dz
-        ret[0] += (f(cell.add(1,1), arr)[2]-f(cell.subtract(1,1), arr)[2])/cell_size[1];
-        ret[0] -= (f(cell.add(2,1), arr)[1]-f(cell.subtract(2,1), arr)[1])/cell_size[2];
+        ret[0] += (f(1, 1)[2]-f(1, -1)[2])/cell_size[1];
+        ret[0] -= (f(2, 1)[1]-f(2, -1)[1])/cell_size[2];
         //(rot F)_y = d F_x / dz - d F_z / dx
-        ret[1] += (f(cell.add(2,1), arr)[0]-f(cell.subtract(2,1), arr)[0])/cell_size[2];
-        ret[1] -= (f(cell.add(0,1), arr)[2]-f(cell.subtract(0,1), arr)[2])/cell_size[0];
+        ret[1] += (f(2, 1)[0]-f(2, -1)[0])/cell_size[2];
+        ret[1] -= (f(0, 1)[2]-f(0, -1)[2])/cell_size[0];
         //(rot F)_z = d F_y / dx - d F_x / dy
-        ret[2] += (f(cell.add(0,1), arr)[1]-f(cell.subtract(0,1), arr)[1])/cell_size[0];
-        ret[2] -= (f(cell.add(1,1), arr)[0]-f(cell.subtract(1,1), arr)[0])/cell_size[1];
+        ret[2] += (f(0, 1)[1]-f(0, -1)[1])/cell_size[0];
+        ret[2] -= (f(1, 1)[0]-f(1, -1)[0])/cell_size[1];
         
         return ret/2;
       }
@@ -120,6 +126,64 @@ namespace AFFPiCS
       }
   }
   
+  template <indexer dim_out, indexer num_dims, class ArrT, class BoundFunc>
+  inline vector_type<FLType, dim_out> curl( const vector_type<indexer, num_dims>& cell,
+                                            const ArrT& arr,
+                                            const BoundFunc & f,
+                                            const vector_type<FLType, num_dims>& cell_size )
+  {
+    return curl_from_neighbours<dim_out, num_dims>( [&](const indexer dim, const indexer sign)
+                                                    { return f(cell.add(dim, sign), arr); },
+                                                    cell_size );
+  }
+  
+  /*!
+    \brief Computes the curl of a field at the cell with linear index \p idx,
+           assuming that the neighbouring cells are at `idx +- strides[dim]`.
+    
+    \warning Performs no boundary checks whatsoever: the cell must not be at the borders of the system.
+  */
+  template <indexer dim_out, indexer num_dims, class ArrT>
+  inline vector_type<FLType, dim_out> strided_curl( const indexer idx,
+                                                    const ArrT& arr,
+                                                    const vector_type<indexer, num_dims>& strides,
+                                                    const vector_type<FLType, num_dims>& cell_size )
+  {
+    return curl_from_neighbours<dim_out, num_dims>( [&](const indexer dim, const indexer sign)
+                                                    { return arr[idx + sign * strides[dim]]; },
+                                                    cell_size );
+  }
+  
+  /*!
+    \brief Computes the same as `strided_curl`, but reading each component that is needed
+           directly from the contiguous arrays of a field stored by components
+           (see `planar_field_holder`), so that consecutive values of \p idx
+           access memory with unit stride.
+    
+    \warning Performs no boundary checks whatsoever: the cell must not be at the borders of the system.
+  */
+  template <indexer dim_out, indexer num_dims, class ArrT>
+  inline vector_type<FLType, dim_out> strided_component_curl( const indexer idx,
+                                                              const ArrT& arr,
+                                                              const vector_type<indexer, num_dims>& strides,
+                                                              const vector_type<FLType, num_dims>& cell_size )
+  {
+    struct component_reader
+    {
+      const ArrT &arr;
+      indexer i;
+      
+      FLType operator[] (const indexer d) const
+      {
+        return arr.component(d)[i];
+      }
+    };
+    
+    return curl_from_neighbours<dim_out, num_dims>( [&](const indexer dim, const indexer sign)
+                                                    { return component_reader{arr, idx + sign * strides[dim]}; },
+                                                    cell_size );
+  }
+  
   CUDA_HOS_DEV inline constexpr FLType constexpr_sqrt(const FLType val)
   {
     if (val < 0)
@@ -0,0 +1,279 @@
+#ifndef AFFPICS_PARTICLE_RESERVOIR
+#define AFFPICS_PARTICLE_RESERVOIR
+
+/*!
+  \file particle_reservoir.h
+  
+  \brief Storage of particles with more memory allocated than the particles currently in use,
+         so that particles can be injected (even from inside kernels, in parallel)
+         without reallocating the whole species every time.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include <atomic>
+
+namespace AFFPiCS
+{
+  /*!
+    \brief The capacity to allocate when at least \p needed elements
+           must fit in an allocation of \p current elements.
+  */
+  inline indexer grown_capacity(const indexer current, const indexer needed)
+  {
+    if (needed <= current)
+      {
+        return current;
+      }
+    const indexer grown = indexer(current * Defaults::particle_growth_factor);
+    return (grown > needed ? grown : needed);
+  }
+  
+  /*!
+    \brief Hands out consecutive slots past the live particles through an atomic bump index,
+           so that many threads can add particles at the same time.
+    
+    \remark Copying it copies the current state, so that the holders stay copyable.
+  */
+  class slot_claimer
+  {
+    private:
+    
+    std::atomic<indexer> next;
+    
+    std::atomic<indexer> straddling;
+    //The start of the (single) claim that did not fit entirely in the capacity,
+    //or -1 if there was none. Every claim after it fails too,
+    //since the bump index only increases.
+    
+    public:
+    
+    slot_claimer(const indexer start = 0): next(start), straddling(-1)
+    {
+    }
+    
+    slot_claimer(const slot_claimer &other): next(other.next.load()), straddling(other.straddling.load())
+    {
+    }
+    
+    slot_claimer& operator= (const slot_claimer &other)
+    {
+      next.store(other.next.load());
+      straddling.store(other.straddling.load());
+      return *this;
+    }
+    
+    void reset(const indexer start)
+    {
+      next.store(start);
+      straddling.store(-1);
+    }
+    
+    /*!
+      \brief Returns the first of \p count consecutive slots,
+             or -1 if they do not fit within \p capacity.
+    */
+    indexer claim(const indexer count, const indexer capacity)
+    {
+      const indexer start = next.fetch_add(count, std::memory_order_relaxed);
+      if (start + count > capacity)
+        {
+          if (start < capacity)
+            {
+              straddling.store(start, std::memory_order_relaxed);
+            }
+          return -1;
+        }
+      return start;
+    }
+    
+    /*!
+      \brief The end of the slots that were successfully claimed.
+    */
+    indexer claimed_end(const indexer capacity) const
+    {
+      const indexer s = straddling.load();
+      if (s >= 0)
+        {
+          return s;
+        }
+      const indexer n = next.load();
+      return (n < capacity ? n : capacity);
+    }
+    
+    /*!
+      \brief The end of all the slots that were requested, including the ones that did not fit.
+    */
+    indexer requested_end() const
+    {
+      return next.load();
+    }
+  };
+  
+  /*!
+    \brief Stores the particles given by \p particle as an array of structures,
+           of which only the first `size()` are live.
+    
+    \remark Injecting particles works in two phases:
+            `reserve` enough memory beforehand, then, possibly from inside a kernel,
+            get the index of free slots with `claim`, write the particles there
+            and, once the kernel is done, make them live with `commit_claims`.
+            The kernels that go through the particles never see the ones that are not committed yet.
+    
+    \remark Input and output only include the live particles.
+  */
+  template <class parallelism, class particle>
+  class particle_aos_holder
+  {
+    public:
+    
+    using value_type = particle;
+    
+    using array_type = g24_lib::array_parallel<parallelism, particle>;
+    
+    private:
+    
+    array_type arr;
+    
+    indexer num;
+    
+    slot_claimer claims;
+    
+    public:
+    
+    particle_aos_holder(const indexer n = 0): num(0)
+    {
+      resize(n);
+    }
+    
+    CUDA_HOS_DEV indexer size() const
+    {
+      return num;
+    }
+    
+    /*!
+      \brief The number of particles that fit in the memory currently allocated.
+    */
+    CUDA_HOS_DEV indexer capacity() const
+    {
+      return arr.size();
+    }
+    
+    /*!
+      \brief Makes sure at least \p n particles fit without reallocating,
+             growing the capacity geometrically (see `Defaults::particle_growth_factor`).
+      
+      \warning Must not be called while slots are being claimed.
+    */
+    void reserve(const indexer n)
+    {
+      const indexer new_capacity = grown_capacity(capacity(), n);
+      if (new_capacity != capacity())
+        {
+          arr.resize(new_capacity);
+        }
+    }
+    
+    /*!
+      \brief Frees the memory beyond the live particles.
+    */
+    void shrink_to_fit()
+    {
+      arr.resize(num);
+    }
+    
+    void resize(const indexer n)
+    {
+      reserve(n);
+      for (indexer i = num; i < n; ++i)
+      //The slots may have held other particles before.
+        {
+          arr[i] = particle{};
+        }
+      num = n;
+      claims.reset(num);
+    }
+    
+    /*!
+      \brief Claims \p count consecutive slots after the live particles
+             and returns the index of the first one, or -1 if there is not enough capacity.
+      
+      \remark Safe to call from several threads at once.
+    */
+    CUDA_ONLY_HOS indexer claim(const indexer count = 1)
+    {
+      return claims.claim(count, capacity());
+    }
+    
+    /*!
+      \brief Makes the particles written to the claimed slots live.
+      
+      \return The number of particles for which slots were requested but did not fit,
+              so that the caller can reserve more memory and try again.
+      
+      \warning Must not be called while slots are being claimed.
+    */
+    indexer commit_claims()
+    {
+      const indexer requested = claims.requested_end();
+      num = claims.claimed_end(capacity());
+      claims.reset(num);
+      return requested - num;
+    }
+    
+    CUDA_HOS_DEV particle& operator[] (const indexer i)
+    {
+      return arr[i];
+    }
+    
+    CUDA_HOS_DEV const particle& operator[] (const indexer i) const
+    {
+      return arr[i];
+    }
+    
+    private:
+    
+    array_type live_particles() const
+    {
+      array_type ret(num);
+      for (indexer i = 0; i < num; ++i)
+        {
+          ret[i] = arr[i];
+        }
+      return ret;
+    }
+    
+    public:
+    
+    template<class stream, class str = std::basic_string<typename stream::char_type>>
+    CUDA_ONLY_HOS void textual_output(stream &s, const str& separator = " ") const
+    {
+      live_particles().textual_output(s, separator);
+    }
+    
+    template<class stream>
+    CUDA_ONLY_HOS void binary_output(stream &s) const
+    {
+      live_particles().binary_output(s);
+    }
+    
+    template<class stream>
+    CUDA_ONLY_HOS void textual_input(stream &s)
+    {
+      arr.textual_input(s);
+      num = arr.size();
+      claims.reset(num);
+    }
+    
+    template<class stream>
+    CUDA_ONLY_HOS void binary_input(stream &s)
+    {
+      arr.binary_input(s);
+      num = arr.size();
+      claims.reset(num);
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,452 @@
+#ifndef AFFPICS_PARTICLE_SOA
+#define AFFPICS_PARTICLE_SOA
+
+/*!
+  \file particle_soa.h
+  
+  \brief Storage of particles as a structure of arrays,
+         with one contiguous array for each component of the particles,
+         so that kernels that only need some of the components
+         do not have to bring the others from memory
+         and can be vectorized across particles.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include "../particles/particle_base.h"
+#include "particle_reservoir.h"
+
+namespace AFFPiCS
+{
+  namespace Particles
+  {
+    /*!
+      \brief Marks the particles given by \p base_particle to be stored as a structure of arrays.
+      
+      \pre \p base_particle must be fully described by its cell, position and momentum
+           and store them as `particle_simple` does (as, for instance, any class derived from it).
+           The mass and the charge of the particles of this type are assumed to be the same
+           for all of them.
+      
+      Use as `Particles::StructureOfArrays<Particles::particle_simple>::template type`.
+    */
+    template <template <indexer> class base_particle>
+    struct StructureOfArrays
+    {
+      template <indexer num_dims>
+      class type : public base_particle<num_dims>
+      {
+        public:
+        
+        using base_particle<num_dims>::base_particle;
+        //Inherit constructors.
+        
+        static constexpr bool structure_of_arrays = true;
+        
+        CUDA_HOS_DEV type(const base_particle<num_dims> &other): base_particle<num_dims>(other)
+        {
+        }
+        
+        CUDA_HOS_DEV const vector_type<indexer, num_dims>& stored_cell() const
+        {
+          return this->grid_position;
+        }
+        
+        CUDA_HOS_DEV const vector_type<FLType, num_dims>& stored_pos() const
+        {
+          return this->position;
+        }
+        
+        CUDA_HOS_DEV const vector_type<FLType, num_dims>& stored_u() const
+        {
+          return this->mom_over_mass;
+        }
+      };
+    };
+  }
+  
+  /*!
+    \brief Behaves as a reference to a particle stored in a `particle_soa_holder`,
+           providing the same interface as the particle itself.
+  */
+  template <class holder>
+  class particle_soa_reference :
+  public Particles::particle_base<holder::value_type::num_dimensions, particle_soa_reference<holder>>
+  {
+    public:
+    
+    using value_type = typename holder::value_type;
+    
+    static constexpr indexer num_dims = value_type::num_dimensions;
+    
+    private:
+    
+    holder * h;
+    indexer idx;
+    
+    public:
+    
+    CUDA_HOS_DEV particle_soa_reference(holder * hold, const indexer i): h(hold), idx(i)
+    {
+    }
+    
+    CUDA_HOS_DEV particle_soa_reference(const particle_soa_reference &other) = default;
+    
+    CUDA_HOS_DEV particle_soa_reference& operator= (const value_type &part)
+    {
+      h->set(idx, part);
+      return *this;
+    }
+    
+    CUDA_HOS_DEV particle_soa_reference& operator= (const particle_soa_reference &other)
+    //Assigning copies the particle, it does not rebind the reference.
+    {
+      h->set(idx, other.h->get(other.idx));
+      return *this;
+    }
+    
+    CUDA_HOS_DEV operator value_type() const
+    {
+      return h->get(idx);
+    }
+    
+    template <class system_info>
+    CUDA_HOS_DEV vector_type<FLType, num_dims> u(const system_info &info) const
+    {
+      vector_type<FLType, num_dims> ret;
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          ret[d] = h->u_component(d)[idx];
+        }
+      return ret;
+    }
+    
+    template <class system_info>
+    CUDA_HOS_DEV vector_type<FLType, num_dims> pos(const system_info &info) const
+    {
+      vector_type<FLType, num_dims> ret;
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          ret[d] = h->pos_component(d)[idx];
+        }
+      return ret;
+    }
+    
+    template <class system_info>
+    CUDA_HOS_DEV vector_type<indexer, num_dims> cell(const system_info &info) const
+    {
+      vector_type<indexer, num_dims> ret;
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          ret[d] = h->cell_component(d)[idx];
+        }
+      return ret;
+    }
+    
+    template <class system_info>
+    CUDA_HOS_DEV FLType mass(const system_info &info) const
+    {
+      return value_type{}.mass(info);
+    }
+    
+    template <class system_info>
+    CUDA_HOS_DEV FLType charge(const system_info &info) const
+    {
+      return value_type{}.charge(info);
+    }
+    
+    template <class system_info>
+    CUDA_HOS_DEV void set_u(const vector_type<FLType, num_dims>& new_u, const system_info &info)
+    {
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          h->u_component(d)[idx] = new_u[d];
+        }
+    }
+    
+    template <class system_info>
+    CUDA_HOS_DEV void set_pos(const vector_type<FLType, num_dims>& new_pos, const system_info &info)
+    {
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          h->pos_component(d)[idx] = new_pos[d];
+        }
+    }
+    
+    template <class system_info>
+    CUDA_HOS_DEV void set_cell(const vector_type<indexer, num_dims>& new_cell, const system_info &info)
+    {
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          h->cell_component(d)[idx] = new_cell[d];
+        }
+    }
+  };
+  
+  /*!
+    \brief Stores the particles given by \p particle with one array for each component
+           of the cells, positions and momenta.
+    
+    \remark Indexing gives a `particle_soa_reference`, which behaves like the particle,
+            so pushers and depositers can be used without changes.
+            Kernels that want to take full advantage of this layout
+            can access the component arrays directly.
+    
+    \remark Particles can be injected by claiming slots past the live ones,
+            as for `particle_aos_holder`.
+    
+    \remark Input and output are done in the same format as an array of structures.
+  */
+  template <class parallelism, class particle>
+  class particle_soa_holder
+  {
+    public:
+    
+    using value_type = particle;
+    
+    using reference = particle_soa_reference<particle_soa_holder>;
+    
+    static constexpr indexer num_dims = particle::num_dimensions;
+    
+    static_assert(!particle_is_weighted<particle>::value, "Only the cells, positions and momenta are stored in this layout!");
+    
+    using real_array = g24_lib::array_parallel<parallelism, FLType>;
+    
+    using index_array = g24_lib::array_parallel<parallelism, indexer>;
+    
+    private:
+    
+    index_array cells[num_dims];
+    real_array positions[num_dims];
+    real_array moms[num_dims];
+    
+    indexer num;
+    
+    slot_claimer claims;
+    
+    static indexer padded_size(const indexer n)
+    {
+      return ((n + Defaults::soa_padding - 1) / Defaults::soa_padding) * Defaults::soa_padding;
+    }
+    
+    public:
+    
+    particle_soa_holder(const indexer n = 0): num(0)
+    {
+      resize(n);
+    }
+    
+    CUDA_HOS_DEV indexer size() const
+    {
+      return num;
+    }
+    
+    /*!
+      \brief The number of elements actually allocated for each component,
+             which is a multiple of `Defaults::soa_padding`.
+    */
+    CUDA_HOS_DEV indexer padded_size() const
+    {
+      return moms[0].size();
+    }
+    
+    /*!
+      \brief The number of particles that fit in the memory currently allocated
+             (the same as `padded_size()`).
+    */
+    CUDA_HOS_DEV indexer capacity() const
+    {
+      return moms[0].size();
+    }
+    
+    /*!
+      \brief Makes sure at least \p n particles fit without reallocating,
+             growing the capacity geometrically (see `Defaults::particle_growth_factor`).
+      
+      \warning Must not be called while slots are being claimed.
+    */
+    void reserve(const indexer n)
+    {
+      const indexer new_capacity = padded_size(grown_capacity(capacity(), n));
+      if (new_capacity != capacity())
+        {
+          reallocate(new_capacity);
+        }
+    }
+    
+    /*!
+      \brief Frees the memory beyond the live particles (and their padding).
+    */
+    void shrink_to_fit()
+    {
+      reallocate(padded_size(num));
+    }
+    
+    void resize(const indexer n)
+    {
+      reserve(n);
+      const indexer p_size = padded_size(n);
+      for (indexer i = num; i < p_size; ++i)
+      //Fill the new elements (and the padding) with the default particle.
+        {
+          set(i, particle{});
+        }
+      num = n;
+      claims.reset(num);
+    }
+    
+    /*!
+      \brief Claims \p count consecutive slots after the live particles
+             and returns the index of the first one, or -1 if there is not enough capacity.
+      
+      \remark Safe to call from several threads at once.
+    */
+    CUDA_ONLY_HOS indexer claim(const indexer count = 1)
+    {
+      return claims.claim(count, capacity());
+    }
+    
+    /*!
+      \brief Makes the particles written to the claimed slots live.
+      
+      \return The number of particles for which slots were requested but did not fit.
+      
+      \warning Must not be called while slots are being claimed.
+    */
+    indexer commit_claims()
+    {
+      const indexer requested = claims.requested_end();
+      num = claims.claimed_end(capacity());
+      claims.reset(num);
+      return requested - num;
+    }
+    
+    CUDA_HOS_DEV index_array& cell_component(const indexer d)
+    {
+      return cells[d];
+    }
+    
+    CUDA_HOS_DEV const index_array& cell_component(const indexer d) const
+    {
+      return cells[d];
+    }
+    
+    CUDA_HOS_DEV real_array& pos_component(const indexer d)
+    {
+      return positions[d];
+    }
+    
+    CUDA_HOS_DEV const real_array& pos_component(const indexer d) const
+    {
+      return positions[d];
+    }
+    
+    CUDA_HOS_DEV real_array& u_component(const indexer d)
+    {
+      return moms[d];
+    }
+    
+    CUDA_HOS_DEV const real_array& u_component(const indexer d) const
+    {
+      return moms[d];
+    }
+    
+    CUDA_HOS_DEV particle get(const indexer i) const
+    {
+      vector_type<indexer, num_dims> c;
+      vector_type<FLType, num_dims> p, m;
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          c[d] = cells[d][i];
+          p[d] = positions[d][i];
+          m[d] = moms[d][i];
+        }
+      return particle(c, p, m);
+    }
+    
+    CUDA_HOS_DEV void set(const indexer i, const particle &part)
+    {
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          cells[d][i] = part.stored_cell()[d];
+          positions[d][i] = part.stored_pos()[d];
+          moms[d][i] = part.stored_u()[d];
+        }
+    }
+    
+    CUDA_HOS_DEV reference operator[] (const indexer i)
+    {
+      return reference(this, i);
+    }
+    
+    CUDA_HOS_DEV particle operator[] (const indexer i) const
+    {
+      return get(i);
+    }
+    
+    private:
+    
+    void reallocate(const indexer new_capacity)
+    {
+      for (indexer d = 0; d < num_dims; ++d)
+        {
+          cells[d].resize(new_capacity);
+          positions[d].resize(new_capacity);
+          moms[d].resize(new_capacity);
+        }
+    }
+    
+    g24_lib::array_parallel<parallelism, particle> to_structures() const
+    {
+      g24_lib::array_parallel<parallelism, particle> ret(num);
+      for (indexer i = 0; i < num; ++i)
+        {
+          ret[i] = get(i);
+        }
+      return ret;
+    }
+    
+    void from_structures(const g24_lib::array_parallel<parallelism, particle> & arr)
+    {
+      num = 0;
+      resize(arr.size());
+      for (indexer i = 0; i < num; ++i)
+        {
+          set(i, arr[i]);
+        }
+    }
+    
+    public:
+    
+    template<class stream, class str = std::basic_string<typename stream::char_type>>
+    CUDA_ONLY_HOS void textual_output(stream &s, const str& separator = " ") const
+    {
+      to_structures().textual_output(s, separator);
+    }
+    
+    template<class stream>
+    CUDA_ONLY_HOS void binary_output(stream &s) const
+    {
+      to_structures().binary_output(s);
+    }
+    
+    template<class stream>
+    CUDA_ONLY_HOS void textual_input(stream &s)
+    {
+      g24_lib::array_parallel<parallelism, particle> temp;
+      temp.textual_input(s);
+      from_structures(temp);
+    }
+    
+    template<class stream>
+    CUDA_ONLY_HOS void binary_input(stream &s)
+    {
+      g24_lib::array_parallel<parallelism, particle> temp;
+      temp.binary_input(s);
+      from_structures(temp);
+    }
+  };
+}
+
+#endif
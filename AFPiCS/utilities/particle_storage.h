@@ -12,6 +12,11 @@
 */
 
 #include "../header.h"
+#include "particle_reservoir.h"
+#include "particle_soa.h"
+#include "stream_compaction.h"
+#include <vector>
+#include <algorithm>
 
 namespace AFFPiCS
 {
@@ -21,6 +26,312 @@ namespace AFFPiCS
   {
     particle_holder<parallelism, particle> particles;
     
+    private:
+    
+    g24_lib::array_parallel<parallelism, indexer> keys, new_keys;
+    //keys holds the (linear) cell indices of the particles at the last sort,
+    //new_keys is just a temporary.
+    
+    g24_lib::array_parallel<parallelism, indexer> offsets;
+    //The particles in the cell with index i were at [offsets[i], offsets[i+1]) at the last sort.
+    
+    particle_holder<parallelism, particle> sort_buffer;
+    
+    index_partitioner<parallelism> partitioner;
+    
+    typename index_partitioner<parallelism>::index_array alive_ids, dead_ids;
+    
+    struct cell_key_functor
+    //Dead particles get total_cells as key, so they end up after all the others.
+    {
+      template <class KeyArr, class PartArr, class S_Info>
+      CUDA_HOS_DEV void operator() (KeyArr &ks, const indexer i, const PartArr& parts, const S_Info &info) const
+      {
+        ks[i] = (parts[i].is_alive(info) ? info.to_index(parts[i].cell(info)) : info.total_cells());
+      }
+    };
+    
+    struct alive_check_functor
+    {
+      template <class PartArr, class S_Info>
+      CUDA_HOS_DEV bool operator() (const PartArr& parts, const indexer i, const S_Info &info) const
+      {
+        return parts[i].is_alive(info);
+      }
+    };
+    
+    struct copy_functor
+    {
+      template <class DestArr, class PartArr, class IdxArr>
+      CUDA_HOS_DEV void operator() (DestArr &dest, const indexer i, const PartArr& parts, const IdxArr &ids) const
+      {
+        dest[i] = parts[ids[i]];
+      }
+    };
+    
+    struct refresh_functor
+    {
+      template <class PartArr, class S_Info>
+      CUDA_HOS_DEV void operator() (PartArr &parts, const indexer i, const S_Info &info) const
+      {
+        parts[i].set_u(parts[i].u(info), info);
+      }
+    };
+    
+    template <class KeyArr>
+    void calculate_offsets(const KeyArr &ks, const indexer total_cells)
+    //Dead particles (key total_cells) and particles injected since the last sort (key -1)
+    //are not counted in any cell.
+    {
+      offsets.resize(total_cells + 1);
+      for (indexer i = 0; i <= total_cells; ++i)
+        {
+          offsets[i] = 0;
+        }
+      for (indexer i = 0; i < ks.size(); ++i)
+        {
+          if (ks[i] >= 0 && ks[i] < total_cells)
+            {
+              ++offsets[ks[i] + 1];
+            }
+        }
+      for (indexer i = 0; i < total_cells; ++i)
+        {
+          offsets[i + 1] += offsets[i];
+        }
+    }
+    
+    void full_sort(const indexer total_cells)
+    //A simple counting sort.
+    {
+      const indexer num = particles.size();
+      
+      keys.resize(num);
+      sort_buffer.resize(num);
+      
+      calculate_offsets(new_keys, total_cells);
+      
+      std::vector<indexer> next(offsets.size());
+      for (indexer i = 0; i <= total_cells; ++i)
+        {
+          next[i] = offsets[i];
+        }
+      //next[total_cells] is where the dead particles go.
+      
+      for (indexer i = 0; i < num; ++i)
+        {
+          const indexer dest = next[new_keys[i]]++;
+          sort_buffer[dest] = particles[i];
+        }
+      
+      using std::swap;
+      swap(particles, sort_buffer);
+      
+      for (indexer i = 0; i < total_cells; ++i)
+        {
+          for (indexer j = offsets[i]; j < offsets[i+1]; ++j)
+            {
+              keys[j] = i;
+            }
+        }
+      for (indexer j = offsets[total_cells]; j < num; ++j)
+        {
+          keys[j] = total_cells;
+        }
+    }
+    
+    bool incremental_sort(const indexer total_cells)
+    //Only the particles that changed cells since the last sort
+    //are taken out and merged back in the right places.
+    //Returns false if too many particles moved for this to be worth it.
+    {
+      const indexer num = particles.size();
+      
+      indexer changed = 0;
+      for (indexer i = 0; i < num; ++i)
+        {
+          changed += (new_keys[i] != keys[i]);
+        }
+        
+      if (changed > Defaults::incremental_sort_threshold * num)
+        {
+          return false;
+        }
+      
+      std::vector<std::pair<indexer, particle>> movers;
+      movers.reserve(changed);
+      
+      indexer stay = 0;
+      
+      for (indexer i = 0; i < num; ++i)
+        {
+          if (new_keys[i] != keys[i])
+            {
+              movers.emplace_back(new_keys[i], particles[i]);
+            }
+          else
+            {
+              if (stay != i)
+                {
+                  particles[stay] = particles[i];
+                  keys[stay] = keys[i];
+                }
+              ++stay;
+            }
+        }
+        
+      std::stable_sort(movers.begin(), movers.end(),
+                       [](const auto &a, const auto &b) { return a.first < b.first; });
+      
+      indexer i = stay - 1, j = indexer(movers.size()) - 1;
+      
+      for (indexer k = num - 1; j >= 0; --k)
+      //Merge from the end, so that nothing is overwritten before being moved.
+        {
+          if (i >= 0 && keys[i] > movers[j].first)
+            {
+              particles[k] = particles[i];
+              keys[k] = keys[i];
+              --i;
+            }
+          else
+            {
+              particles[k] = movers[j].second;
+              keys[k] = movers[j].first;
+              --j;
+            }
+        }
+      
+      calculate_offsets(keys, total_cells);
+      
+      return true;
+    }
+    
+    public:
+    
+    /*!
+      \brief Sorts the particles according to the linear index of the cell they are in.
+      
+      \param incremental If `true` and the particles were sorted before,
+                         only the particles that have changed cells since then are relocated
+                         (unless there are too many of them, see `Defaults::incremental_sort_threshold`).
+      
+      \remark The incremental sort assumes the particles have not been reordered
+              in any other way since the last sort. If they have been, call `invalidate_sort()`.
+    */
+    template <class system_info>
+    void sort_by_cell(const system_info &info, const bool incremental = true)
+    {
+      const indexer num = particles.size();
+      
+      new_keys.resize(num);
+      
+      parallelism::loop(new_keys, cell_key_functor{}, particles, info);
+      
+      if (incremental && keys.size() > 0 && keys.size() < num)
+      //Particles were injected since the last sort:
+      //they are handled as any other particles that changed cells.
+        {
+          const indexer old_num = keys.size();
+          keys.resize(num);
+          for (indexer i = old_num; i < num; ++i)
+            {
+              keys[i] = -1;
+            }
+        }
+      
+      if (!incremental || keys.size() != num || !incremental_sort(info.total_cells()))
+        {
+          full_sort(info.total_cells());
+        }
+    }
+    
+    /*!
+      \brief Forgets the last sort, so that the next one will be a full sort.
+    */
+    void invalidate_sort()
+    {
+      keys.resize(0);
+      offsets.resize(0);
+    }
+    
+    /*!
+      \brief Takes the dead particles (see `particle_base::kill`) out of the storage,
+             keeping the relative order of the others, if they are more than
+             a fraction \p threshold of all the particles.
+      
+      \return `true` if the particles were removed
+              (in which case the kernel sizes estimated for this species must be recomputed).
+    */
+    template <class system_info>
+    bool remove_dead(const system_info &info, const FLType threshold = Defaults::dead_particle_threshold)
+    {
+      const indexer num = particles.size();
+      
+      const indexer alive = partitioner.template count<alive_check_functor>(particles, info);
+      
+      if (alive == num || num - alive < threshold * num)
+        {
+          return false;
+        }
+      
+      partitioner.scatter(alive_ids, dead_ids);
+      
+      sort_buffer.resize(alive);
+      
+      parallelism::loop(sort_buffer, copy_functor{}, particles, alive_ids);
+      
+      using std::swap;
+      swap(particles, sort_buffer);
+      
+      invalidate_sort();
+      
+      return true;
+    }
+    
+    /*!
+      \brief Sets the momentum of every particle again,
+             so that whatever they compute from it and from the units of the system
+             (such as `Particles::particle_cached_gamma`) matches \p info.
+    */
+    template <class system_info>
+    void refresh(const system_info &info)
+    {
+      parallelism::loop(particles, refresh_functor{}, info);
+    }
+    
+    /*!
+      \brief Makes sure \p count more particles can be injected
+             (see `particle_aos_holder::claim`) without reallocating.
+    */
+    void reserve_injection(const indexer count)
+    {
+      particles.reserve(particles.size() + count);
+    }
+    
+    /*!
+      \brief Makes the particles injected since the last call live.
+      
+      \return The number of particles that could not be injected for lack of capacity.
+      
+      \remark Since the new particles are added at the end,
+              the next sort will handle them as particles that changed cells.
+    */
+    indexer commit_injection()
+    {
+      return particles.commit_claims();
+    }
+    
+    /*!
+      \brief Returns the offsets of the first particle in each cell
+              (with one last extra element holding the number of live particles,
+              the dead ones being after those) as they were at the last sort.
+    */
+    const g24_lib::array_parallel<parallelism, indexer>& cell_offsets() const
+    {
+      return offsets;
+    }
+    
     template <class stream> void save(stream &s, bool binary = Defaults::data_i_o_as_binary) const
     {
       if (binary)
@@ -43,6 +354,7 @@ namespace AFFPiCS
         {
           particles.textual_input(s);
         }
+      invalidate_sort();
     }
   };
 
@@ -76,6 +388,45 @@ namespace AFFPiCS
       one.load(s, binary);
     }
   
+    template <class system_info, class Arg, class ... Args>
+    static void sort_helper(const system_info &info, const bool incremental, Arg& one, Args& ... others)
+    {
+      one.sort_by_cell(info, incremental);
+      sort_helper(info, incremental, others...);
+    }
+    
+    template <class system_info, class Arg>
+    static void sort_helper(const system_info &info, const bool incremental, Arg& one)
+    {
+      one.sort_by_cell(info, incremental);
+    }
+    
+    template <class system_info, class Arg, class ... Args>
+    static bool remove_helper(const system_info &info, const FLType threshold, Arg& one, Args& ... others)
+    {
+      const bool removed = one.remove_dead(info, threshold);
+      return remove_helper(info, threshold, others...) || removed;
+    }
+    
+    template <class system_info, class Arg>
+    static bool remove_helper(const system_info &info, const FLType threshold, Arg& one)
+    {
+      return one.remove_dead(info, threshold);
+    }
+    
+    template <class system_info, class Arg, class ... Args>
+    static void refresh_helper(const system_info &info, Arg& one, Args& ... others)
+    {
+      one.refresh(info);
+      refresh_helper(info, others...);
+    }
+    
+    template <class system_info, class Arg>
+    static void refresh_helper(const system_info &info, Arg& one)
+    {
+      one.refresh(info);
+    }
+  
     template <class Arg, class ... Args>
     indexer size_helper(const Arg& one, const Args& ... others) const
     {
@@ -116,6 +467,54 @@ namespace AFFPiCS
       return size_helper(static_cast<const particle_storage_part<parallelism, particles>&>(*this)...);
     }
     
+    /*!
+      \brief Sorts the particles of every species according to the cell they are in,
+             so that particles that are close in space are close in memory.
+             
+      \sa particle_storage_part::sort_by_cell
+    */
+    template <class system_info>
+    void sort_by_cell(const system_info &info, const bool incremental = true)
+    {
+      sort_helper(info, incremental, static_cast<particle_storage_part<parallelism, particles>&>(*this)...);
+    }
+    
+    /*!
+      \brief Takes the dead particles out of the storage for every species
+             where they are more than a fraction \p threshold of the particles.
+      
+      \return `true` if any particles were removed.
+      
+      \sa particle_storage_part::remove_dead
+    */
+    template <class system_info>
+    bool remove_dead(const system_info &info, const FLType threshold = Defaults::dead_particle_threshold)
+    {
+      return remove_helper(info, threshold, static_cast<particle_storage_part<parallelism, particles>&>(*this)...);
+    }
+    
+    /*!
+      \brief Sets the momentum of every particle of every species again
+             (see `particle_storage_part::refresh`).
+    */
+    template <class system_info>
+    void refresh(const system_info &info)
+    {
+      refresh_helper(info, static_cast<particle_storage_part<parallelism, particles>&>(*this)...);
+    }
+    
+    template <class particle>
+    particle_storage_part<parallelism, particle>& get_part()
+    {
+      return *static_cast<particle_storage_part<parallelism, particle>*>(this);
+    }
+    
+    template <class particle>
+    const particle_storage_part<parallelism, particle>& get_part() const
+    {
+      return *static_cast<const particle_storage_part<parallelism, particle>*>(this);
+    }
+    
     template <class particle>
     particle_holder<parallelism, particle>& get_particles()
     {
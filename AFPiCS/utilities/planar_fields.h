@@ -0,0 +1,342 @@
+#ifndef AFFPICS_PLANAR_FIELD_HOLDER
+#define AFFPICS_PLANAR_FIELD_HOLDER
+
+/*!
+  \file planar_fields.h
+  
+  \brief Storage of vector fields with one contiguous (padded) plane per component,
+         so that the kernels that go over the cells access each component with unit stride.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+
+namespace AFFPiCS
+{
+  /*!
+    \brief Behaves as a reference to the value of a field stored in a `planar_field_holder`.
+    
+    \remark Indexing gives a reference to the component itself,
+            so `arr[i][d] += x` and atomic additions to components work as usual.
+  */
+  template <class holder>
+  class planar_field_reference
+  {
+    public:
+    
+    using value_type = typename holder::value_type;
+    
+    private:
+    
+    holder * h;
+    indexer idx;
+    
+    public:
+    
+    CUDA_HOS_DEV planar_field_reference(holder * hold, const indexer i): h(hold), idx(i)
+    {
+    }
+    
+    CUDA_HOS_DEV planar_field_reference(const planar_field_reference &other) = default;
+    
+    CUDA_HOS_DEV planar_field_reference& operator= (const value_type &val)
+    {
+      h->set(idx, val);
+      return *this;
+    }
+    
+    CUDA_HOS_DEV planar_field_reference& operator= (const planar_field_reference &other)
+    //Assigning copies the value, it does not rebind the reference.
+    {
+      h->set(idx, other.h->get(other.idx));
+      return *this;
+    }
+    
+    CUDA_HOS_DEV operator value_type() const
+    {
+      return h->get(idx);
+    }
+    
+    CUDA_HOS_DEV value_type value() const
+    {
+      return h->get(idx);
+    }
+    
+    CUDA_HOS_DEV FLType& operator[] (const indexer d) const
+    {
+      return h->component(d)[idx];
+    }
+    
+    CUDA_HOS_DEV static constexpr indexer size()
+    {
+      return holder::num_components;
+    }
+    
+    CUDA_HOS_DEV void set_all(const FLType val)
+    {
+      for (indexer d = 0; d < size(); ++d)
+        {
+          (*this)[d] = val;
+        }
+    }
+    
+    CUDA_HOS_DEV planar_field_reference& operator+= (const value_type &val)
+    {
+      for (indexer d = 0; d < size(); ++d)
+        {
+          (*this)[d] += val[d];
+        }
+      return *this;
+    }
+    
+    CUDA_HOS_DEV planar_field_reference& operator-= (const value_type &val)
+    {
+      for (indexer d = 0; d < size(); ++d)
+        {
+          (*this)[d] -= val[d];
+        }
+      return *this;
+    }
+    
+    CUDA_HOS_DEV planar_field_reference& operator*= (const FLType val)
+    {
+      for (indexer d = 0; d < size(); ++d)
+        {
+          (*this)[d] *= val;
+        }
+      return *this;
+    }
+    
+    CUDA_HOS_DEV planar_field_reference& operator/= (const FLType val)
+    {
+      for (indexer d = 0; d < size(); ++d)
+        {
+          (*this)[d] /= val;
+        }
+      return *this;
+    }
+    
+    //The arithmetic operators just work on the values.
+    
+    CUDA_HOS_DEV friend value_type operator+ (const planar_field_reference &a, const value_type &b)
+    {
+      return a.value() + b;
+    }
+    
+    CUDA_HOS_DEV friend value_type operator+ (const value_type &a, const planar_field_reference &b)
+    {
+      return a + b.value();
+    }
+    
+    CUDA_HOS_DEV friend value_type operator- (const planar_field_reference &a, const value_type &b)
+    {
+      return a.value() - b;
+    }
+    
+    CUDA_HOS_DEV friend value_type operator- (const value_type &a, const planar_field_reference &b)
+    {
+      return a - b.value();
+    }
+    
+    CUDA_HOS_DEV friend value_type operator- (const planar_field_reference &a)
+    {
+      return a.value() * FLType(-1);
+    }
+    
+    CUDA_HOS_DEV friend value_type operator* (const planar_field_reference &a, const FLType b)
+    {
+      return a.value() * b;
+    }
+    
+    CUDA_HOS_DEV friend value_type operator* (const FLType a, const planar_field_reference &b)
+    {
+      return b.value() * a;
+    }
+    
+    CUDA_HOS_DEV friend value_type operator/ (const planar_field_reference &a, const FLType b)
+    {
+      return a.value() / b;
+    }
+  };
+  
+  /*!
+    \brief Stores an array of vectors with \p components components
+           with one array for each of the components.
+    
+    \remark Indexing gives a `planar_field_reference`, which behaves like the vector,
+            so the field evolvers, gathers and depositers can be used without changes.
+            Since each component is contiguous, loops over the cells
+            access memory with unit stride and can be vectorized.
+    
+    \remark Input and output are done in the same format as an array of vectors,
+            so checkpoints can be freely exchanged between both layouts.
+  */
+  template <class parallelism, indexer components>
+  class planar_field_holder
+  {
+    public:
+    
+    using value = g24_lib::fspoint<FLType, indexer, components>;
+    
+    using value_type = value;
+    
+    using reference = planar_field_reference<planar_field_holder>;
+    
+    static constexpr indexer num_components = components;
+    
+    using plane_type = g24_lib::array_parallel<parallelism, FLType>;
+    
+    private:
+    
+    plane_type planes[num_components];
+    
+    indexer num;
+    
+    static indexer padded_size(const indexer n)
+    {
+      return ((n + Defaults::soa_padding - 1) / Defaults::soa_padding) * Defaults::soa_padding;
+    }
+    
+    public:
+    
+    planar_field_holder(const indexer n = 0): num(0)
+    {
+      resize(n);
+    }
+    
+    CUDA_HOS_DEV indexer size() const
+    {
+      return num;
+    }
+    
+    /*!
+      \brief The number of elements actually allocated for each component,
+             which is a multiple of `Defaults::soa_padding`.
+    */
+    CUDA_HOS_DEV indexer padded_size() const
+    {
+      return planes[0].size();
+    }
+    
+    void resize(const indexer n)
+    {
+      const indexer p_size = padded_size(n);
+      for (indexer d = 0; d < num_components; ++d)
+        {
+          planes[d].resize(p_size);
+        }
+      for (indexer i = num; i < p_size; ++i)
+        {
+          set(i, value(FLType(0)));
+        }
+      num = n;
+    }
+    
+    /*!
+      \brief The (contiguous) array with the \p d th component of all the elements.
+    */
+    CUDA_HOS_DEV plane_type& component(const indexer d)
+    {
+      return planes[d];
+    }
+    
+    CUDA_HOS_DEV const plane_type& component(const indexer d) const
+    {
+      return planes[d];
+    }
+    
+    CUDA_HOS_DEV value get(const indexer i) const
+    {
+      value ret;
+      for (indexer d = 0; d < num_components; ++d)
+        {
+          ret[d] = planes[d][i];
+        }
+      return ret;
+    }
+    
+    CUDA_HOS_DEV void set(const indexer i, const value &val)
+    {
+      for (indexer d = 0; d < num_components; ++d)
+        {
+          planes[d][i] = val[d];
+        }
+    }
+    
+    CUDA_HOS_DEV reference operator[] (const indexer i)
+    {
+      return reference(this, i);
+    }
+    
+    CUDA_HOS_DEV value operator[] (const indexer i) const
+    {
+      return get(i);
+    }
+    
+    private:
+    
+    g24_lib::array_parallel<parallelism, value> to_structures() const
+    {
+      g24_lib::array_parallel<parallelism, value> ret(num);
+      for (indexer i = 0; i < num; ++i)
+        {
+          ret[i] = get(i);
+        }
+      return ret;
+    }
+    
+    void from_structures(const g24_lib::array_parallel<parallelism, value> & arr)
+    {
+      num = 0;
+      resize(arr.size());
+      for (indexer i = 0; i < num; ++i)
+        {
+          set(i, arr[i]);
+        }
+    }
+    
+    public:
+    
+    template<class stream, class str = std::basic_string<typename stream::char_type>>
+    CUDA_ONLY_HOS void textual_output(stream &s, const str& separator = " ") const
+    {
+      to_structures().textual_output(s, separator);
+    }
+    
+    template<class stream>
+    CUDA_ONLY_HOS void binary_output(stream &s) const
+    {
+      to_structures().binary_output(s);
+    }
+    
+    template<class stream>
+    CUDA_ONLY_HOS void textual_input(stream &s)
+    {
+      g24_lib::array_parallel<parallelism, value> temp;
+      temp.textual_input(s);
+      from_structures(temp);
+    }
+    
+    template<class stream>
+    CUDA_ONLY_HOS void binary_input(stream &s)
+    {
+      g24_lib::array_parallel<parallelism, value> temp;
+      temp.binary_input(s);
+      from_structures(temp);
+    }
+  };
+  
+  template <class T, class = void>
+  struct has_planar_components : std::false_type {};
+  
+  /*!
+    \brief Whether the components of the elements of a \p T can be accessed
+           as contiguous arrays (through `component(d)`), as in a `planar_field_holder`.
+  */
+  template <class T>
+  struct has_planar_components<T, std::void_t<decltype(std::declval<const T &>().component(0))>> :
+  std::true_type {};
+}
+
+#endif
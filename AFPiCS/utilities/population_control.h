@@ -0,0 +1,413 @@
+#ifndef AFFPICS_POPULATION_CONTROL
+#define AFFPICS_POPULATION_CONTROL
+
+/*!
+  \file population_control.h
+  
+  \brief Keeps the number of particles in each cell within a given range
+         by merging particles in the cells with too many of them
+         and splitting particles in the cells with too few.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include "particle_storage.h"
+#include "stream_compaction.h"
+#include "tracing.h"
+#include <vector>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+
+namespace AFFPiCS
+{
+  namespace PopulationControl
+  {
+    /*!
+      \brief The range of particles per cell to keep each species in.
+    */
+    struct band
+    {
+      indexer min_ppc = 0, target_ppc = 0, max_ppc = 0;
+      //Cells with more than max_ppc particles have them merged
+      //and cells with some, but less than min_ppc, have them split,
+      //both towards target_ppc.
+      
+      indexer momentum_bins = Defaults::population_momentum_bins;
+      //Only particles in the same bin (in each dimension) of the range of momenta
+      //of the particles in the cell are merged.
+      
+      FLType energy_tolerance = Defaults::population_energy_tolerance;
+      //The largest relative change in energy when merging particles
+      //for which there is no way to conserve it exactly (in one dimension, basically).
+      
+      FLType split_displacement = Defaults::population_split_displacement;
+    };
+    
+    /*!
+      \brief Applies a `band` to the species of weighted particles (see `Particles::particle_weighted`)
+             of a `particle_storage`, leaving the others unchanged.
+      
+      \remark Merging follows Vranic et al. (2015): the particles in each momentum bin
+              are replaced by two particles with half the total weight each,
+              at their weighted mean position, with momenta of the same magnitude
+              symmetrically placed around the total momentum, so that the charge,
+              the momentum and the energy are all conserved exactly.
+              Splitting halves the weight of a particle and places the two halves
+              symmetrically around its original position, in rounds that split
+              every particle of the cell, so that, when `target_ppc` is the number
+              of particles in the cell times a power of two, all of them end up with the same weight.
+      
+      \remark The new particles of each cell go to their own range of slots,
+              given by a prefix sum over the cells, so their order does not depend on the threads.
+      
+      \remark The particles of each cell are handled by a single thread, so this runs on the host.
+    */
+    template <class parallelism>
+    class controller
+    {
+      private:
+      
+      g24_lib::array_parallel<parallelism, indexer> created;
+      //Holds how many particles each cell needs and then,
+      //after the scan, where the first of them goes.
+      
+      index_scanner<parallelism> scanner;
+      
+      template <class particle, class PartArr, class S_Info>
+      static bool merge_group(PartArr &parts, const indexer * members, const indexer m, const band &b, const S_Info &info)
+      //Replaces the m particles whose indices are in members by two,
+      //returning false if it could not be done within the tolerance.
+      {
+        using namespace std;
+        
+        constexpr indexer num_dims = particle::num_dimensions;
+        
+        const FLType c = info.units().c();
+        
+        FLType total_w = 0, total_gamma = 0;
+        vector_type<FLType, num_dims> total_u(0), total_pos(0);
+        
+        for (indexer j = 0; j < m; ++j)
+          {
+            const particle p = parts[members[j]];
+            const FLType w = p.weight(info);
+            total_w += w;
+            total_gamma += w * p.gamma(info);
+            total_u = total_u + p.u(info) * w;
+            total_pos = total_pos + p.pos(info) * w;
+          }
+        
+        const FLType gamma_t = total_gamma / total_w;
+        const FLType u_t = c * sqrt(max(gamma_t * gamma_t - 1, FLType(0)));
+        const FLType u_norm = sqrt(total_u.square_norm2());
+        
+        vector_type<FLType, num_dims> u_a = total_u / total_w, u_b = total_u / total_w;
+        
+        vector_type<FLType, num_dims> e_2(0);
+        bool has_e_2 = false;
+        
+        if (u_t > 0 && u_norm < total_w * u_t)
+          {
+            vector_type<FLType, num_dims> e_1 = total_u;
+            for (indexer j = 0; j < m && e_1.square_norm2() <= 0; ++j)
+            //If the total momentum is zero, any direction will do,
+            //and the particles cannot all be at rest here.
+              {
+                e_1 = parts[members[j]].u(info);
+              }
+            e_1 = e_1 / sqrt(e_1.square_norm2());
+            
+            for (indexer j = 0; j < m && !has_e_2; ++j)
+            //A direction perpendicular to the total momentum,
+            //taken from the particles themselves when possible.
+              {
+                const vector_type<FLType, num_dims> u_j = parts[members[j]].u(info);
+                FLType proj = 0;
+                for (indexer d = 0; d < num_dims; ++d)
+                  {
+                    proj += u_j[d] * e_1[d];
+                  }
+                const vector_type<FLType, num_dims> perp = u_j - e_1 * proj;
+                const FLType perp_norm = sqrt(perp.square_norm2());
+                if (perp_norm > Defaults::precision * sqrt(u_j.square_norm2()))
+                  {
+                    e_2 = perp / perp_norm;
+                    has_e_2 = true;
+                  }
+              }
+            
+            if (!has_e_2 && num_dims > 1)
+              {
+                indexer axis = 0;
+                for (indexer d = 1; d < num_dims; ++d)
+                  {
+                    axis = (abs(e_1[d]) < abs(e_1[axis]) ? d : axis);
+                  }
+                vector_type<FLType, num_dims> perp = e_1 * (-e_1[axis]);
+                perp[axis] += 1;
+                e_2 = perp / sqrt(perp.square_norm2());
+                has_e_2 = true;
+              }
+            
+            if (has_e_2)
+              {
+                const FLType cos_w = u_norm / (total_w * u_t);
+                const FLType sin_w = sqrt(max(1 - cos_w * cos_w, FLType(0)));
+                u_a = (e_1 * cos_w + e_2 * sin_w) * u_t;
+                u_b = (e_1 * cos_w - e_2 * sin_w) * u_t;
+              }
+          }
+        
+        if (!has_e_2)
+        //Both particles get the mean momentum, which loses some energy.
+          {
+            const FLType gamma_new = sqrt(u_a.square_norm2() / (c * c) + 1);
+            if (gamma_t - gamma_new > b.energy_tolerance * gamma_t)
+              {
+                return false;
+              }
+          }
+        
+        particle p_a = parts[members[0]], p_b = parts[members[1]];
+        
+        p_a.set_pos(total_pos / total_w, info);
+        p_a.set_u(u_a, info);
+        p_a.set_weight(total_w / 2, info);
+        
+        p_b.set_pos(total_pos / total_w, info);
+        p_b.set_u(u_b, info);
+        p_b.set_weight(total_w / 2, info);
+        
+        parts[members[0]] = p_a;
+        parts[members[1]] = p_b;
+        
+        for (indexer j = 2; j < m; ++j)
+          {
+            particle p = parts[members[j]];
+            p.kill(info);
+            parts[members[j]] = p;
+          }
+        
+        return true;
+      }
+      
+      template <class particle, class PartArr, class S_Info>
+      static void merge(PartArr &parts, const indexer begin, const indexer end, const band &b, const S_Info &info)
+      {
+        using namespace std;
+        
+        constexpr indexer num_dims = particle::num_dimensions;
+        
+        const indexer num = end - begin;
+        
+        vector_type<FLType, num_dims> u_min = parts[begin].u(info), u_max = u_min;
+        for (indexer i = begin + 1; i < end; ++i)
+          {
+            const vector_type<FLType, num_dims> u = parts[i].u(info);
+            for (indexer d = 0; d < num_dims; ++d)
+              {
+                u_min[d] = min(u_min[d], u[d]);
+                u_max[d] = max(u_max[d], u[d]);
+              }
+          }
+        
+        indexer num_bins = 1;
+        for (indexer d = 0; d < num_dims; ++d)
+          {
+            num_bins *= b.momentum_bins;
+          }
+        
+        std::vector<indexer> bin_of(num), starts(num_bins + 1, 0), members(num);
+        
+        for (indexer i = 0; i < num; ++i)
+          {
+            const vector_type<FLType, num_dims> u = parts[begin + i].u(info);
+            indexer bin = 0;
+            for (indexer d = num_dims - 1; d >= 0; --d)
+              {
+                const FLType range = u_max[d] - u_min[d];
+                const indexer k = (range > 0 ? indexer((u[d] - u_min[d]) / range * b.momentum_bins) : 0);
+                bin = bin * b.momentum_bins + min(k, b.momentum_bins - 1);
+              }
+            bin_of[i] = bin;
+            ++starts[bin + 1];
+          }
+        
+        std::partial_sum(starts.begin(), starts.end(), starts.begin());
+        
+        {
+          std::vector<indexer> next(starts.begin(), starts.end() - 1);
+          for (indexer i = 0; i < num; ++i)
+            {
+              members[next[bin_of[i]]++] = begin + i;
+            }
+        }
+        
+        std::vector<indexer> bins(num_bins);
+        std::iota(bins.begin(), bins.end(), 0);
+        std::sort(bins.begin(), bins.end(), [&](const indexer x, const indexer y)
+                  { return starts[x + 1] - starts[x] > starts[y + 1] - starts[y]; });
+        //The most populated bins are merged first.
+        
+        indexer excess = num - b.target_ppc;
+        
+        for (const indexer bin : bins)
+          {
+            const indexer in_bin = starts[bin + 1] - starts[bin];
+            if (excess <= 0 || in_bin < 3)
+              {
+                break;
+              }
+            const indexer m = min(in_bin, excess + 2);
+            //Merging m particles into two removes m - 2.
+            if (merge_group<particle>(parts, members.data() + starts[bin], m, b, info))
+              {
+                excess -= m - 2;
+              }
+          }
+      }
+      
+      template <class particle, class PartArr, class S_Info>
+      static void split(PartArr &parts, const indexer begin, const indexer end,
+                        const indexer first, const indexer needed, const band &b, const S_Info &info)
+      //Creates needed particles in the slots starting at first.
+      {
+        using namespace std;
+        
+        constexpr indexer num_dims = particle::num_dimensions;
+        
+        const indexer num = end - begin;
+        
+        indexer made = 0;
+        
+        for (indexer round = 0; made < needed; ++round)
+          {
+            const indexer current = num + made;
+            //Each round splits the particles there were when it started:
+            //the original ones first and then the ones created in earlier rounds.
+            
+            const indexer dim = round % num_dims;
+            
+            for (indexer k = 0; k < current && made < needed; ++k, ++made)
+              {
+                const indexer source = (k < num ? begin + k : first + (k - num));
+                
+                particle p = parts[source];
+                p.set_weight(p.weight(info) / 2, info);
+                
+                const vector_type<FLType, num_dims> pos = p.pos(info);
+                const FLType delta = min(b.split_displacement / 2, min(pos[dim], 1 - pos[dim]));
+                //Both halves stay in the cell, symmetrically around the original position.
+                
+                particle q = p;
+                p.set_pos(pos.add(dim, -delta), info);
+                q.set_pos(pos.add(dim, delta), info);
+                
+                parts[source] = p;
+                parts[first + made] = q;
+              }
+          }
+      }
+      
+      struct count_functor
+      {
+        template <class CountArr, class OffsetArr>
+        CUDA_HOS_DEV void operator() (CountArr &counts, const indexer c, const OffsetArr &offsets, const band &b) const
+        {
+          const indexer num = offsets[c + 1] - offsets[c];
+          counts[c] = (num > 0 && num < b.min_ppc && b.target_ppc > num ? b.target_ppc - num : 0);
+        }
+      };
+      
+      template <class particle>
+      struct cell_functor
+      {
+        template <class CreatedArr, class PartArr, class OffsetArr, class S_Info>
+        CUDA_ONLY_HOS void operator() (const CreatedArr &created_offsets,
+                                       const indexer c,
+                                       PartArr &parts,
+                                       const OffsetArr &offsets,
+                                       const indexer first,
+                                       const indexer total_created,
+                                       const band &b,
+                                       const S_Info &info) const
+        {
+          const indexer begin = offsets[c], end = offsets[c + 1];
+          const indexer num = end - begin;
+          const indexer next = (c + 1 < created_offsets.size() ? created_offsets[c + 1] : total_created);
+          if (num > b.max_ppc)
+            {
+              merge<particle>(parts, begin, end, b, info);
+            }
+          else if (next > created_offsets[c] && first >= 0)
+            {
+              split<particle>(parts, begin, end, first + created_offsets[c], next - created_offsets[c], b, info);
+            }
+        }
+      };
+      
+      template <class particle, class system_info>
+      bool control_species(particle_storage_part<parallelism, particle> &part, const band &b, const system_info &info)
+      {
+        if constexpr (!particle_is_weighted<particle>::value)
+          {
+            return false;
+          }
+        else
+          {
+            part.sort_by_cell(info);
+            
+            const auto &offsets = part.cell_offsets();
+            const indexer total_cells = info.total_cells();
+            
+            if (created.size() != total_cells)
+              {
+                created.resize(total_cells);
+              }
+            
+            parallelism::loop(created, count_functor{}, offsets, b);
+            
+            const indexer to_create = scanner.exclusive_scan(created);
+            
+            const indexer before = part.particles.size();
+            
+            part.reserve_injection(to_create);
+            
+            const indexer first = (to_create > 0 ? part.particles.claim(to_create) : 0);
+            //A single claim, split among the cells according to the scan.
+            
+            parallelism::loop(created, Tracing::trace("population control", cell_functor<particle>{}),
+                              part.particles, offsets, first, to_create, b, info);
+            
+            part.commit_injection();
+            
+            const bool grown = (part.particles.size() != before);
+            const bool shrunk = part.remove_dead(info, FLType(0));
+            
+            return grown || shrunk;
+          }
+      }
+      
+      public:
+      
+      /*!
+        \brief Merges and splits the weighted particles of \p storage according to \p b.
+        
+        \return `true` if the number of particles changed
+                (in which case the kernel sizes must be estimated again).
+        
+        \remark The particles are sorted by cell first, and the merged particles
+                are taken out of the storage (along with any other dead ones) at the end.
+      */
+      template <class ... particles, class system_info>
+      bool apply(particle_storage<parallelism, particles...> &storage, const band &b, const system_info &info)
+      {
+        return (control_species<particles>(storage.template get_part<particles>(), b, info) | ...);
+      }
+    };
+  }
+}
+
+#endif
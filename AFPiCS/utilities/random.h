@@ -0,0 +1,144 @@
+#ifndef AFFPICS_RANDOM
+#define AFFPICS_RANDOM
+
+/*!
+  \file random.h
+  
+  \brief Counter-based random number generation (Philox-4x32-10),
+         so that any number of independent streams can be created on the fly
+         from a seed and a few identifiers, with no state to share between threads.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include <cstdint>
+#include <cmath>
+
+namespace AFFPiCS
+{
+  namespace Random
+  {
+    /*!
+      \brief The Philox-4x32-10 bijection of Salmon et al.,
+             which maps a 128-bit counter to 128 random bits under a 64-bit key.
+    */
+    struct philox4x32
+    {
+      static constexpr uint32_t M0 = 0xD2511F53u, M1 = 0xCD9E8D57u;
+      static constexpr uint32_t W0 = 0x9E3779B9u, W1 = 0xBB67AE85u;
+      static constexpr indexer rounds = 10;
+      
+      CUDA_HOS_DEV static void generate(const uint32_t (&counter)[4], uint32_t k0, uint32_t k1, uint32_t (&out)[4])
+      {
+        uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2], c3 = counter[3];
+        for (indexer r = 0; r < rounds; ++r)
+          {
+            const uint64_t p0 = uint64_t(M0) * c0, p1 = uint64_t(M1) * c2;
+            const uint32_t hi0 = uint32_t(p0 >> 32), lo0 = uint32_t(p0);
+            const uint32_t hi1 = uint32_t(p1 >> 32), lo1 = uint32_t(p1);
+            c0 = hi1 ^ c1 ^ k0;
+            c1 = lo1;
+            c2 = hi0 ^ c3 ^ k1;
+            c3 = lo0;
+            k0 += W0;
+            k1 += W1;
+          }
+        out[0] = c0;
+        out[1] = c1;
+        out[2] = c2;
+        out[3] = c3;
+      }
+    };
+    
+    /*!
+      \brief A stream of random numbers identified by a \p seed, a \p step and a \p stream_id,
+             which always gives the same sequence for the same identifiers.
+      
+      \remark Creating one is free (there is no state to initialize beyond the identifiers),
+              so each thread (or each unit of work) can simply create its own
+              and parallel generation needs no locks and is reproducible.
+    */
+    class counter_stream
+    {
+      private:
+      
+      uint32_t key[2];
+      uint32_t counter[4];
+      //counter[0] counts the blocks of four values already used,
+      //the rest identify the stream.
+      
+      uint32_t block[4];
+      indexer used;
+      
+      CUDA_HOS_DEV uint32_t next_bits()
+      {
+        if (used == 4)
+          {
+            philox4x32::generate(counter, key[0], key[1], block);
+            ++counter[0];
+            used = 0;
+          }
+        return block[used++];
+      }
+      
+      public:
+      
+      CUDA_HOS_DEV counter_stream(const uint64_t seed, const uint64_t step, const uint64_t stream_id):
+      key{uint32_t(seed), uint32_t(seed >> 32)},
+      counter{0, uint32_t(stream_id), uint32_t(step), uint32_t(step >> 32) ^ (uint32_t(stream_id >> 32) * philox4x32::W0)},
+      block{0, 0, 0, 0}, used(4)
+      {
+      }
+      
+      /*!
+        \brief Returns a uniformly distributed number in ]0, 1].
+      */
+      CUDA_HOS_DEV FLType uniform()
+      {
+        const uint64_t hi = next_bits(), lo = next_bits();
+        const uint64_t bits = (hi << 21) ^ (lo >> 11);
+        //53 random bits, enough for the mantissa of a double.
+        return FLType(bits + 1) * FLType(1.0/9007199254740992.0);
+      }
+      
+      /*!
+        \brief Returns a normally distributed number, with zero mean and unit variance.
+      */
+      CUDA_HOS_DEV FLType normal()
+      //Box-Muller, discarding the second value so there is no state to carry.
+      {
+        using namespace std;
+        const FLType r = sqrt(FLType(-2) * log(uniform()));
+        return r * cos(2 * g24_lib::pi<FLType> * uniform());
+      }
+      
+      /*!
+        \brief Returns a number following a Gamma distribution
+               with shape \p half_shape / 2 and unit scale.
+        
+        \remark Only half-integer (and integer) shapes are supported,
+                since those are all that is needed for the relativistic distributions
+                and can be generated exactly without any rejection.
+      */
+      CUDA_HOS_DEV FLType gamma_half(const indexer half_shape)
+      {
+        using namespace std;
+        FLType prod = 1;
+        for (indexer i = 0; i < half_shape/2; ++i)
+          {
+            prod *= uniform();
+          }
+        FLType ret = -log(prod);
+        if (half_shape % 2)
+          {
+            const FLType z = normal();
+            ret += z * z / 2;
+          }
+        return ret;
+      }
+    };
+  }
+}
+
+#endif
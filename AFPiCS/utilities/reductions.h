@@ -0,0 +1,206 @@
+#ifndef AFFPICS_REDUCTIONS
+#define AFFPICS_REDUCTIONS
+
+/*!
+  \file reductions.h
+  
+  \brief Strategies for accumulating the contributions of many particles
+         into the same grid quantities (for instance, during charge deposition).
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+
+namespace AFFPiCS
+{
+  namespace Reductions
+  {
+    /*!
+      \brief Every contribution is added atomically to the final array.
+      
+      \remark Simple and with no memory overhead, but the threads contend
+              in regions with many particles and, since the order of the additions
+              is not fixed, the results are not bitwise reproducible.
+    */
+    struct Atomic
+    {
+      static constexpr bool private_buffers = false;
+      
+      template <class parallelism, class T>
+      CUDA_HOS_DEV static void add(T &dest, const T &val)
+      {
+        parallelism::atomics::add(dest, val);
+      }
+    };
+    
+    /*!
+      \brief The particles are split in \p num_chunks contiguous chunks,
+             each accumulating into its own private copy of the array,
+             and the copies are then summed, cell by cell, always in the same order.
+      
+      \remark Since the chunks do not depend on the number of threads,
+              the results are bitwise reproducible.
+      
+      \remark This needs \p num_chunks copies of the array being accumulated,
+              so it is best suited to shared memory systems with a moderate number of threads.
+              (There should be at least as many chunks as threads, though.)
+    */
+    template <indexer num_chunks = Defaults::reduction_chunks>
+    struct PrivateBuffers
+    {
+      static constexpr bool private_buffers = true;
+      
+      static constexpr indexer chunks = num_chunks;
+      
+      template <class parallelism, class T>
+      CUDA_HOS_DEV static void add(T &dest, const T &val)
+      {
+        dest += val;
+      }
+    };
+  }
+  
+  /*!
+    \brief Holds the private copies of an array used by `Reductions::PrivateBuffers`
+           and the (particle) chunks that correspond to each.
+  */
+  template <class parallelism, class value>
+  class private_buffer_holder
+  {
+    g24_lib::array_parallel<parallelism, value> buffers;
+    g24_lib::array_parallel<parallelism, indexer> ends;
+    indexer stride;
+    typename parallelism::kernel_size_type reduce_kernel;
+    //For the loop of `reduce`.
+    
+    public:
+    
+    /*!
+      \brief A view of one of the buffers that can be indexed as the original array.
+    */
+    template <class Arr>
+    struct buffer_view
+    {
+      Arr * arr;
+      indexer offset;
+      
+      CUDA_HOS_DEV auto& operator[] (const indexer i) const
+      {
+        return (*arr)[offset + i];
+      }
+    };
+    
+    private_buffer_holder(): stride(0)
+    {
+    }
+    
+    /*!
+      \brief Makes room for \p num_chunks copies of \p dest,
+             into which the results will be reduced (see `reduce`).
+    */
+    template <class Arr>
+    void resize(const indexer num_chunks, const Arr &dest)
+    {
+      const indexer size = dest.size();
+      stride = ((size + Defaults::reduction_padding - 1) / Defaults::reduction_padding) * Defaults::reduction_padding;
+      //So that different buffers do not share cache lines.
+      buffers.resize(num_chunks * stride);
+      ends.resize(num_chunks);
+      reduce_kernel = parallelism::template estimate_loop_kernel_size
+                          < Arr, reduce_functor, g24_lib::array_parallel<parallelism, value>, indexer, indexer > (size);
+    }
+    
+    indexer num_chunks() const
+    {
+      return ends.size();
+    }
+    
+    /*!
+      \brief Splits \p num_elements (evenly) among the chunks.
+    */
+    void split(const indexer num_elements)
+    {
+      const indexer n = num_chunks();
+      for (indexer c = 0; c < n; ++c)
+        {
+          ends[c] = (num_elements * (c + 1)) / n;
+        }
+    }
+    
+    /*!
+      \brief Loops over the chunks, calling `functor(parts, i, view, args...)`
+             for each element `i` of each chunk, with `view` being the corresponding private buffer.
+      
+      \param clear If `true`, the buffers are set to zero first.
+                   Otherwise, the contributions are added to the ones already there.
+    */
+    template <class Functor, class PartArr, class ... Args>
+    void accumulate(PartArr &parts, const bool clear, Args&& ... args)
+    {
+      split(parts.size());
+      parallelism::loop(ends, chunk_functor<Functor>{}, parts, buffers, stride, clear, std::forward<Args>(args)...);
+    }
+    
+    /*!
+      \brief Sets each element of \p dest to the sum of the buffers, in a fixed order.
+      
+      \pre \p dest must be of the same type and size as the array given to `resize`.
+    */
+    template <class Arr>
+    void reduce(Arr &dest) const
+    {
+      parallelism::loop(reduce_kernel, dest, reduce_functor{}, buffers, stride, num_chunks());
+    }
+    
+    private:
+    
+    template <class Functor>
+    struct chunk_functor
+    {
+      template <class EndsArr, class PartArr, class BuffArr, class ... Args>
+      CUDA_HOS_DEV void operator() (const EndsArr &chunk_ends,
+                                    const indexer c,
+                                    PartArr &parts,
+                                    BuffArr &buffs,
+                                    const indexer buff_stride,
+                                    const bool clear,
+                                    const Args& ... args) const
+      {
+        if (clear)
+          {
+            for (indexer j = c * buff_stride; j < (c + 1) * buff_stride; ++j)
+              {
+                buffs[j].set_all(0);
+              }
+          }
+        
+        buffer_view<BuffArr> view{&buffs, c * buff_stride};
+        
+        for (indexer i = (c == 0 ? 0 : chunk_ends[c - 1]); i < chunk_ends[c]; ++i)
+          {
+            Functor{}(parts, i, view, args...);
+          }
+      }
+    };
+    
+    struct reduce_functor
+    {
+      template <class Arr, class BuffArr>
+      CUDA_HOS_DEV void operator() (Arr &dest,
+                                    const indexer i,
+                                    const BuffArr &buffs,
+                                    const indexer buff_stride,
+                                    const indexer n_chunks) const
+      {
+        dest[i] = buffs[i];
+        for (indexer c = 1; c < n_chunks; ++c)
+          {
+            dest[i] += buffs[c * buff_stride + i];
+          }
+      }
+    };
+  };
+}
+
+#endif
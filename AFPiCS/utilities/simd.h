@@ -0,0 +1,287 @@
+#ifndef AFFPICS_SIMD
+#define AFFPICS_SIMD
+
+/*!
+  \file simd.h
+  
+  \brief Packs of values that are operated on in lockstep,
+         mapped onto the native vector registers through the compiler's
+         vector extensions when those are available,
+         and vectors of such packs for the batched particle kernels.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include <cmath>
+
+#if defined(__GNUC__) && !defined(__CUDA_ARCH__)
+#define AFFPICS_SIMD_VECTOR_EXTENSIONS 1
+#else
+#define AFFPICS_SIMD_VECTOR_EXTENSIONS 0
+#endif
+
+namespace AFFPiCS
+{
+  namespace SIMD
+  {
+    /*!
+      \brief The size (in bytes) of the native vector registers.
+    */
+    inline constexpr indexer native_bytes =
+#if defined(__AVX512F__)
+    64;
+#elif defined(__AVX__)
+    32;
+#else
+    16;
+#endif
+
+    /*!
+      \brief The number of values of type \p T that fit in a native vector register.
+    */
+    template <class T>
+    inline constexpr indexer native_width = (native_bytes / indexer(sizeof(T)) > 1 ? native_bytes / indexer(sizeof(T)) : 1);
+    
+    /*!
+      \brief Holds \p W values of type \p T, to which all operations are applied together.
+    */
+    template <class T, indexer W = native_width<T>>
+    struct pack
+    {
+#if AFFPICS_SIMD_VECTOR_EXTENSIONS
+      typedef T storage_type __attribute__((vector_size(W * sizeof(T))));
+#else
+      typedef T storage_type[W];
+#endif
+
+      storage_type v;
+      
+      static constexpr indexer width = W;
+      
+      CUDA_HOS_DEV pack() = default;
+      
+      CUDA_HOS_DEV pack(const T val)
+      //Broadcasts val to all the lanes.
+      {
+        for (indexer l = 0; l < W; ++l)
+          {
+            v[l] = val;
+          }
+      }
+      
+      CUDA_HOS_DEV T lane(const indexer l) const
+      {
+        return v[l];
+      }
+      
+      CUDA_HOS_DEV void set_lane(const indexer l, const T val)
+      {
+        v[l] = val;
+      }
+
+#if AFFPICS_SIMD_VECTOR_EXTENSIONS
+#define AFFPICS_SIMD_PACK_OPERATOR(OP)                                           \
+      CUDA_HOS_DEV friend pack operator OP (const pack &a, const pack &b)        \
+      {                                                                          \
+        pack ret;                                                                \
+        ret.v = a.v OP b.v;                                                      \
+        return ret;                                                              \
+      }                                                                          \
+      CUDA_HOS_DEV pack& operator OP ## = (const pack &other)                    \
+      {                                                                          \
+        v = v OP other.v;                                                        \
+        return *this;                                                            \
+      }
+#else
+#define AFFPICS_SIMD_PACK_OPERATOR(OP)                                           \
+      CUDA_HOS_DEV friend pack operator OP (const pack &a, const pack &b)        \
+      {                                                                          \
+        pack ret;                                                                \
+        for (indexer l = 0; l < W; ++l)                                          \
+          {                                                                      \
+            ret.v[l] = a.v[l] OP b.v[l];                                         \
+          }                                                                      \
+        return ret;                                                              \
+      }                                                                          \
+      CUDA_HOS_DEV pack& operator OP ## = (const pack &other)                    \
+      {                                                                          \
+        for (indexer l = 0; l < W; ++l)                                          \
+          {                                                                      \
+            v[l] = v[l] OP other.v[l];                                           \
+          }                                                                      \
+        return *this;                                                            \
+      }
+#endif
+
+      AFFPICS_SIMD_PACK_OPERATOR(+)
+      AFFPICS_SIMD_PACK_OPERATOR(-)
+      AFFPICS_SIMD_PACK_OPERATOR(*)
+      AFFPICS_SIMD_PACK_OPERATOR(/)
+
+#undef AFFPICS_SIMD_PACK_OPERATOR
+
+      CUDA_HOS_DEV friend pack operator- (const pack &a)
+      {
+        return pack(T(0)) - a;
+      }
+      
+      CUDA_HOS_DEV friend pack sqrt(const pack &a)
+      //With the vector extensions, this is turned into the packed square root.
+      {
+        using namespace std;
+        pack ret;
+        for (indexer l = 0; l < W; ++l)
+          {
+            ret.v[l] = sqrt(T(a.v[l]));
+          }
+        return ret;
+      }
+    };
+    
+    /*!
+      \brief A vector with \p N components, each holding the values for \p W different particles.
+    */
+    template <indexer N, indexer W = native_width<FLType>>
+    struct vec
+    {
+      using scalar = pack<FLType, W>;
+      
+      scalar c[N];
+      
+      CUDA_HOS_DEV static constexpr indexer size()
+      {
+        return N;
+      }
+      
+      CUDA_HOS_DEV scalar& operator[] (const indexer d)
+      {
+        return c[d];
+      }
+      
+      CUDA_HOS_DEV const scalar& operator[] (const indexer d) const
+      {
+        return c[d];
+      }
+      
+      /*!
+        \brief Sets the values for the \p l th particle.
+      */
+      CUDA_HOS_DEV void set_lane(const indexer l, const vector_type<FLType, N> &val)
+      {
+        for (indexer d = 0; d < N; ++d)
+          {
+            c[d].set_lane(l, val[d]);
+          }
+      }
+      
+      CUDA_HOS_DEV scalar square_norm2() const
+      {
+        scalar ret = c[0] * c[0];
+        for (indexer d = 1; d < N; ++d)
+          {
+            ret += c[d] * c[d];
+          }
+        return ret;
+      }
+      
+      CUDA_HOS_DEV friend vec operator+ (const vec &a, const vec &b)
+      {
+        vec ret;
+        for (indexer d = 0; d < N; ++d)
+          {
+            ret.c[d] = a.c[d] + b.c[d];
+          }
+        return ret;
+      }
+      
+      CUDA_HOS_DEV friend vec operator- (const vec &a, const vec &b)
+      {
+        vec ret;
+        for (indexer d = 0; d < N; ++d)
+          {
+            ret.c[d] = a.c[d] - b.c[d];
+          }
+        return ret;
+      }
+      
+      CUDA_HOS_DEV friend vec operator* (const vec &a, const scalar &s)
+      {
+        vec ret;
+        for (indexer d = 0; d < N; ++d)
+          {
+            ret.c[d] = a.c[d] * s;
+          }
+        return ret;
+      }
+      
+      CUDA_HOS_DEV friend vec operator* (const scalar &s, const vec &a)
+      {
+        return a * s;
+      }
+      
+      CUDA_HOS_DEV friend vec operator/ (const vec &a, const scalar &s)
+      {
+        vec ret;
+        for (indexer d = 0; d < N; ++d)
+          {
+            ret.c[d] = a.c[d] / s;
+          }
+        return ret;
+      }
+    };
+  }
+  
+  template <indexer num_dims_1, indexer num_dims_2, indexer W>
+  CUDA_HOS_DEV inline auto cross_product(const SIMD::vec<num_dims_1, W> &a, const SIMD::vec<num_dims_2, W> &b)
+  //Same conventions as for the single particle version.
+  {
+    if constexpr (num_dims_1 == 1 && num_dims_2 == 1)
+      {
+        return SIMD::vec<1, W>{{FLType(0)}};
+      }
+    else if constexpr (num_dims_1 == 1 && num_dims_2 == 2)
+      {
+        return SIMD::vec<2, W>{{-a[0]*b[1], a[0]*b[0]}};
+      }
+    else if constexpr (num_dims_1 == 2 && num_dims_2 == 1)
+      {
+        return SIMD::vec<2, W>{{a[1]*b[0], -a[0]*b[0]}};
+      }
+    else if constexpr (num_dims_1 == 2 && num_dims_2 == 2)
+      {
+        return SIMD::vec<1, W>{{a[0]*b[1] - a[1]*b[0]}};
+      }
+    else
+      {
+        static_assert(num_dims_1 == 3 && num_dims_2 == 3, "Invalid cross product!");
+        return SIMD::vec<3, W>{{ a[1]*b[2] - a[2]*b[1],
+                                 a[2]*b[0] - a[0]*b[2],
+                                 a[0]*b[1] - a[1]*b[0] }};
+      }
+  }
+  
+  template <indexer num_dims_1, indexer num_dims_2, indexer W>
+  CUDA_HOS_DEV inline typename SIMD::vec<num_dims_1, W>::scalar dot_product(const SIMD::vec<num_dims_1, W> &a,
+                                                                            const SIMD::vec<num_dims_2, W> &b)
+  //Same conventions as for the single particle version.
+  {
+    if constexpr ((num_dims_1 == 1 && num_dims_2 == 2) || (num_dims_1 == 2 && num_dims_2 == 1))
+      {
+        return FLType(0);
+      }
+    else
+      {
+        typename SIMD::vec<num_dims_1, W>::scalar ret = a[0] * b[0];
+        for (indexer d = 1; d < num_dims_1; ++d)
+          {
+            ret += a[d] * b[d];
+          }
+        return ret;
+      }
+  }
+}
+
+#undef AFFPICS_SIMD_VECTOR_EXTENSIONS
+
+#endif
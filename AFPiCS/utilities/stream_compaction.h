@@ -0,0 +1,242 @@
+#ifndef AFFPICS_STREAM_COMPACTION
+#define AFFPICS_STREAM_COMPACTION
+
+/*!
+  \file stream_compaction.h
+  
+  \brief Splits the indices of an array according to a predicate,
+         keeping their relative order, with a (chunked) parallel prefix sum,
+         which is also available on its own.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+
+namespace AFFPiCS
+{
+  /*!
+    \brief Holds the temporaries needed to replace the elements of an array
+           by their exclusive prefix sum, so that counts become offsets.
+    
+    \remark As for `index_partitioner`, the array is split in `Defaults::compaction_chunks` chunks
+            that are summed and then scanned in parallel,
+            with only the prefix sum over the chunks being done serially.
+  */
+  template <class parallelism>
+  class index_scanner
+  {
+    public:
+    
+    using index_array = g24_lib::array_parallel<parallelism, indexer>;
+    
+    private:
+    
+    index_array ends, offsets;
+    
+    struct sum_functor
+    {
+      template <class EndsArr, class ValArr, class OffsetArr>
+      CUDA_HOS_DEV void operator() (const EndsArr &chunk_ends, const indexer c, const ValArr &vals, OffsetArr &sums) const
+      {
+        indexer sum = 0;
+        for (indexer i = (c == 0 ? 0 : chunk_ends[c - 1]); i < chunk_ends[c]; ++i)
+          {
+            sum += vals[i];
+          }
+        sums[c] = sum;
+      }
+    };
+    
+    struct scan_functor
+    {
+      template <class EndsArr, class ValArr, class OffsetArr>
+      CUDA_HOS_DEV void operator() (const EndsArr &chunk_ends, const indexer c, ValArr &vals, const OffsetArr &offs) const
+      {
+        indexer running = offs[c];
+        for (indexer i = (c == 0 ? 0 : chunk_ends[c - 1]); i < chunk_ends[c]; ++i)
+          {
+            const indexer val = vals[i];
+            vals[i] = running;
+            running += val;
+          }
+      }
+    };
+    
+    public:
+    
+    index_scanner(): ends(Defaults::compaction_chunks), offsets(Defaults::compaction_chunks)
+    {
+    }
+    
+    /*!
+      \brief Replaces each element of \p values by the sum of the ones before it.
+      
+      \return The sum of all the elements.
+    */
+    template <class Arr>
+    indexer exclusive_scan(Arr &values)
+    {
+      const indexer num = values.size();
+      const indexer num_chunks = ends.size();
+      
+      for (indexer c = 0; c < num_chunks; ++c)
+        {
+          ends[c] = (num * (c + 1)) / num_chunks;
+        }
+      
+      parallelism::loop(ends, sum_functor{}, values, offsets);
+      
+      indexer total = 0;
+      
+      for (indexer c = 0; c < num_chunks; ++c)
+        {
+          const indexer sum = offsets[c];
+          offsets[c] = total;
+          total += sum;
+        }
+      
+      parallelism::loop(ends, scan_functor{}, values, offsets);
+      
+      return total;
+    }
+  };
+  
+  /*!
+    \brief Holds the temporaries needed to partition the indices of an array.
+    
+    \remark The array is split in `Defaults::compaction_chunks` chunks
+            that are counted and then scattered in parallel,
+            with only the prefix sum over the chunks being done serially.
+  */
+  template <class parallelism>
+  class index_partitioner
+  {
+    public:
+    
+    using index_array = g24_lib::array_parallel<parallelism, indexer>;
+    
+    private:
+    
+    index_array flags, ends, offsets;
+    
+    indexer total_selected;
+    
+    template <class Pred>
+    struct flag_functor
+    {
+      template <class FlagArr, class Arr, class ... Args>
+      CUDA_HOS_DEV void operator() (FlagArr &flgs, const indexer i, const Arr &arr, const Args& ... args) const
+      {
+        flgs[i] = Pred{}(arr, i, args...);
+      }
+    };
+    
+    struct count_functor
+    {
+      template <class EndsArr, class FlagArr, class OffsetArr>
+      CUDA_HOS_DEV void operator() (const EndsArr &chunk_ends, const indexer c, const FlagArr &flgs, OffsetArr &counts) const
+      {
+        indexer count = 0;
+        for (indexer i = (c == 0 ? 0 : chunk_ends[c - 1]); i < chunk_ends[c]; ++i)
+          {
+            count += flgs[i];
+          }
+        counts[c] = count;
+      }
+    };
+    
+    struct scatter_functor
+    {
+      template <class EndsArr, class FlagArr, class OffsetArr, class IdxArr>
+      CUDA_HOS_DEV void operator() (const EndsArr &chunk_ends,
+                                    const indexer c,
+                                    const FlagArr &flgs,
+                                    const OffsetArr &offs,
+                                    IdxArr &selected,
+                                    IdxArr &rest              ) const
+      {
+        const indexer begin = (c == 0 ? 0 : chunk_ends[c - 1]);
+        indexer sel = offs[c], other = begin - offs[c];
+        for (indexer i = begin; i < chunk_ends[c]; ++i)
+          {
+            if (flgs[i])
+              {
+                selected[sel++] = i;
+              }
+            else
+              {
+                rest[other++] = i;
+              }
+          }
+      }
+    };
+    
+    public:
+    
+    index_partitioner(): ends(Defaults::compaction_chunks), offsets(Defaults::compaction_chunks), total_selected(0)
+    {
+    }
+    
+    /*!
+      \brief Returns the number of indices `i` of \p arr for which
+             `Pred{}(arr, i, args...)` is `true`.
+      
+      \remark The indices can then be split with `scatter`,
+              so this can be used to check if partitioning is worth it at all.
+    */
+    template <class Pred, class Arr, class ... Args>
+    indexer count(const Arr &arr, const Args& ... args)
+    {
+      const indexer num = arr.size();
+      const indexer num_chunks = ends.size();
+      
+      flags.resize(num);
+      
+      parallelism::loop(flags, flag_functor<Pred>{}, arr, args...);
+      
+      for (indexer c = 0; c < num_chunks; ++c)
+        {
+          ends[c] = (num * (c + 1)) / num_chunks;
+        }
+      
+      parallelism::loop(ends, count_functor{}, flags, offsets);
+      
+      total_selected = 0;
+      
+      for (indexer c = 0; c < num_chunks; ++c)
+        {
+          const indexer count = offsets[c];
+          offsets[c] = total_selected;
+          total_selected += count;
+        }
+      
+      return total_selected;
+    }
+    
+    /*!
+      \brief Splits the indices counted in the last call to `count`.
+    */
+    void scatter(index_array &selected, index_array &rest)
+    {
+      selected.resize(total_selected);
+      rest.resize(flags.size() - total_selected);
+      
+      parallelism::loop(ends, scatter_functor{}, flags, offsets, selected, rest);
+    }
+    
+    /*!
+      \brief Fills \p selected with the indices `i` of \p arr for which
+             `Pred{}(arr, i, args...)` is `true` and \p rest with all the others,
+             both in increasing order.
+    */
+    template <class Pred, class Arr, class ... Args>
+    void partition(const Arr &arr, index_array &selected, index_array &rest, const Args& ... args)
+    {
+      count<Pred>(arr, args...);
+      scatter(selected, rest);
+    }
+  };
+}
+
+#endif
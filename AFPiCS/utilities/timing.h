@@ -0,0 +1,163 @@
+#ifndef AFFPICS_TIMING_UTILITIES
+#define AFFPICS_TIMING_UTILITIES
+
+/*!
+  \file timing.h
+  
+  \brief Wall-clock timing of the stages of the simulation,
+         enabled at compile time by defining `AFFPICS_TIMING`.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+
+#ifdef AFFPICS_TIMING
+#include <chrono>
+#endif
+
+namespace AFFPiCS
+{
+  namespace Timing
+  {
+    /*!
+      \brief Identifies each of the diagnostic functions that may be called during a step.
+    */
+    enum hook : indexer
+    {
+      pre_step = 0,
+      injection,
+      before_mover,
+      after_mover,
+      before_pusher,
+      after_pusher,
+      before_evolver,
+      after_evolver,
+      before_depositer,
+      after_depositer,
+      post_step,
+      num_hooks
+    };
+    
+    /*!
+      \brief The time (in seconds) spent in each stage of one or more steps,
+             along with the amount of work done.
+      
+      \remark Unless `AFFPICS_TIMING` is defined, all the times stay at 0.
+    */
+    struct step_timings
+    {
+      double mover = 0, pusher = 0, evolver = 0, depositer = 0;
+      
+      double fused = 0;
+      //When the particle stages are fused, they can't be timed separately.
+      
+      double sorting = 0;
+      //Includes the removal of the dead particles and the population control.
+      
+      double hooks[num_hooks] = {};
+      //The time spent in each of the diagnostics.
+      
+      indexer steps = 0;
+      
+      indexer particles_pushed = 0;
+      
+      indexer cells_updated = 0;
+      
+      double diagnostics() const
+      {
+        double ret = 0;
+        for (indexer i = 0; i < num_hooks; ++i)
+          {
+            ret += hooks[i];
+          }
+        return ret;
+      }
+      
+      double total() const
+      {
+        return mover + pusher + evolver + depositer + fused + sorting + diagnostics();
+      }
+      
+      /*!
+        \brief The number of particles pushed per second of time spent handling the particles.
+      */
+      double particles_per_second() const
+      {
+        const double t = mover + pusher + depositer + fused;
+        return (t > 0 ? particles_pushed / t : 0);
+      }
+      
+      /*!
+        \brief The number of cells updated per second of time spent evolving the fields.
+      */
+      double cells_per_second() const
+      {
+        return (evolver > 0 ? cells_updated / evolver : 0);
+      }
+      
+      step_timings& operator+= (const step_timings &other)
+      {
+        mover += other.mover;
+        pusher += other.pusher;
+        evolver += other.evolver;
+        depositer += other.depositer;
+        fused += other.fused;
+        sorting += other.sorting;
+        for (indexer i = 0; i < num_hooks; ++i)
+          {
+            hooks[i] += other.hooks[i];
+          }
+        steps += other.steps;
+        particles_pushed += other.particles_pushed;
+        cells_updated += other.cells_updated;
+        return *this;
+      }
+    };
+
+#ifdef AFFPICS_TIMING
+
+    /*!
+      \brief Adds the wall time between its construction and its destruction to \p target.
+    */
+    class scoped_timer
+    {
+      using clock = std::chrono::steady_clock;
+      
+      double &target;
+      clock::time_point start;
+      
+      public:
+      
+      scoped_timer(double &t): target(t), start(clock::now())
+      {
+      }
+      
+      scoped_timer(const scoped_timer &) = delete;
+      
+      ~scoped_timer()
+      {
+        target += std::chrono::duration<double>(clock::now() - start).count();
+      }
+    };
+
+#else
+
+    class scoped_timer
+    //Does nothing, so it is optimized away entirely.
+    {
+      public:
+      
+      scoped_timer(double &)
+      {
+      }
+      
+      scoped_timer(const scoped_timer &) = delete;
+    };
+
+#endif
+
+  }
+}
+
+#endif
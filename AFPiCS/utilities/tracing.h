@@ -0,0 +1,268 @@
+#ifndef AFFPICS_TRACING_UTILITIES
+#define AFFPICS_TRACING_UTILITIES
+
+/*!
+  \file tracing.h
+  
+  \brief Records when each thread starts and stops working on each kernel,
+         so that the timeline can be inspected (as Chrome trace-event JSON,
+         e. g. in chrome://tracing or Perfetto) to find load imbalance and stalls.
+         Enabled at compile time by defining `AFFPICS_TRACING`.
+  
+  \author Nuno Fernandes
+*/
+
+#include "../header.h"
+#include <cstdint>
+
+#ifdef AFFPICS_TRACING
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#endif
+
+namespace AFFPiCS
+{
+  namespace Tracing
+  {
+
+#ifdef AFFPICS_TRACING
+
+    /*!
+      \brief The time interval during which a thread was working on something.
+    */
+    struct event
+    {
+      const char * name;
+      indexer launch;
+      //Identifies the kernel launch, so the intervals of consecutive launches are kept separate.
+      int64_t begin, end;
+      //In nanoseconds since the start of the program.
+    };
+    
+    /*!
+      \brief Holds the latest `Defaults::trace_buffer_events` events of a single thread,
+             overwriting the oldest ones.
+      
+      \remark Only the owning thread ever writes to it, so no locks are needed.
+    */
+    struct thread_buffer
+    {
+      event events[Defaults::trace_buffer_events];
+      
+      std::atomic<indexer> head{0};
+      //The total number of events ever written.
+      
+      event open{nullptr, -1, 0, 0};
+      //The interval of the kernel the thread is currently working on,
+      //which is extended as long as it keeps working on the same launch.
+      
+      indexer unclocked = 0;
+      //The number of elements of the open launch handled since the clock was last read.
+      
+      indexer thread_id = 0;
+      
+      void push(const event &e)
+      {
+        const indexer h = head.load(std::memory_order_relaxed);
+        events[h % Defaults::trace_buffer_events] = e;
+        head.store(h + 1, std::memory_order_release);
+      }
+      
+      void close()
+      {
+        if (open.launch >= 0)
+          {
+            push(open);
+            open.launch = -1;
+          }
+      }
+    };
+    
+    namespace detail
+    {
+      inline std::atomic<thread_buffer *> buffers[Defaults::trace_max_threads] = {};
+      
+      inline std::atomic<indexer> num_buffers{0};
+      
+      inline std::atomic<indexer> launches{0};
+      
+      inline const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+      
+      inline int64_t now()
+      {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+      }
+      
+      inline thread_buffer * local_buffer()
+      //The buffer of the calling thread, registered the first time it is needed.
+      //The buffers are never freed, so that they can still be dumped after the threads exit.
+      {
+        thread_local thread_buffer * buf = nullptr;
+        if (buf == nullptr)
+          {
+            buf = new thread_buffer;
+            const indexer id = num_buffers.fetch_add(1);
+            buf->thread_id = id;
+            if (id < Defaults::trace_max_threads)
+              {
+                buffers[id].store(buf, std::memory_order_release);
+              }
+            //Further threads are still traced, but their events are not dumped.
+          }
+        return buf;
+      }
+    }
+    
+    /*!
+      \brief Wraps \p Functor so that each thread records the interval
+             during which it worked on a given launch of the kernel.
+      
+      \remark Only one event is recorded per thread and launch, and the clock is only read
+              when the thread starts on the launch, after its first element
+              and then once every `Defaults::trace_clock_interval` elements,
+              so the end of the interval may miss up to that many elements.
+    */
+    template <class Functor>
+    struct traced_functor
+    {
+      Functor func;
+      const char * name;
+      indexer launch;
+      
+      template <class ... Args>
+      CUDA_HOS_DEV void operator() (Args&& ... args) const
+      {
+#ifdef __CUDA_ARCH__
+        func(std::forward<Args>(args)...);
+#else
+        thread_buffer * buf = detail::local_buffer();
+        if (buf->open.launch != launch)
+          {
+            buf->close();
+            const int64_t t = detail::now();
+            buf->open = event{name, launch, t, t};
+            buf->unclocked = Defaults::trace_clock_interval - 1;
+            //So that the clock is read after the first element too.
+          }
+        func(std::forward<Args>(args)...);
+        if (++buf->unclocked >= Defaults::trace_clock_interval)
+          {
+            buf->open.end = detail::now();
+            buf->unclocked = 0;
+          }
+#endif
+      }
+    };
+    
+    /*!
+      \brief Returns \p func wrapped so that the intervals each thread spends on it are recorded.
+      
+      \remark To be used as `parallelism::loop(arr, Tracing::trace("name", functor{}), args...)`.
+              Each call to this counts as a different launch.
+    */
+    template <class Functor>
+    inline traced_functor<Functor> trace(const char * name, const Functor &func)
+    {
+      return traced_functor<Functor>{func, name, detail::launches.fetch_add(1, std::memory_order_relaxed)};
+    }
+    
+    /*!
+      \brief The type of what `trace` returns for a \p Functor,
+             for estimating the kernel sizes of the traced loops.
+    */
+    template <class Functor>
+    using traced_t = traced_functor<Functor>;
+    
+    /*!
+      \brief Records the interval between its construction and its destruction
+             on the calling thread, including any time spent waiting for other threads.
+    */
+    class scope
+    {
+      event e;
+      
+      public:
+      
+      scope(const char * name): e{name, 0, detail::now(), 0}
+      {
+      }
+      
+      scope(const scope &) = delete;
+      
+      ~scope()
+      {
+        e.end = detail::now();
+        e.launch = detail::launches.fetch_add(1, std::memory_order_relaxed);
+        detail::local_buffer()->push(e);
+      }
+    };
+    
+    /*!
+      \brief Writes all the recorded events to \p filename in the Chrome trace-event format.
+      
+      \warning Must not be called while any kernel is running,
+               since the intervals still open are closed here.
+    */
+    inline void dump(const StrType& filename)
+    {
+      std::ofstream file(filename);
+      file << "{\"traceEvents\":[";
+      bool first = true;
+      const indexer num = std::min(detail::num_buffers.load(), Defaults::trace_max_threads);
+      for (indexer t = 0; t < num; ++t)
+        {
+          thread_buffer * buf = detail::buffers[t].load(std::memory_order_acquire);
+          if (buf == nullptr)
+            {
+              continue;
+            }
+          buf->close();
+          const indexer head = buf->head.load(std::memory_order_acquire);
+          const indexer start = (head > Defaults::trace_buffer_events ? head - Defaults::trace_buffer_events : 0);
+          for (indexer i = start; i < head; ++i)
+            {
+              const event &e = buf->events[i % Defaults::trace_buffer_events];
+              file << (first ? "" : ",") << "\n{\"name\":\"" << e.name
+                   << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buf->thread_id
+                   << ",\"ts\":" << e.begin / 1000.0 << ",\"dur\":" << (e.end - e.begin) / 1000.0 << "}";
+              first = false;
+            }
+        }
+      file << "\n]}\n";
+    }
+
+#else
+
+    template <class Functor>
+    CUDA_HOS_DEV inline Functor trace(const char *, const Functor &func)
+    //Without tracing, the functor is used as is.
+    {
+      return func;
+    }
+    
+    template <class Functor>
+    using traced_t = Functor;
+    
+    class scope
+    {
+      public:
+      
+      scope(const char *)
+      {
+      }
+      
+      scope(const scope &) = delete;
+    };
+    
+    inline void dump(const StrType&)
+    {
+    }
+
+#endif
+
+  }
+}
+
+#endif